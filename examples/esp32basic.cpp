@@ -8,21 +8,69 @@
 
 HardwareSerial gpsSerial( 1 );  // use the ESP32 second serial port
 ublox gps;                      // this is initializing the parser. The buffer is in this object
-navpvt8 nav( gps );             // this defines the UBX-NAV-PVT message
-cfggnss gc( gps );              // this defines the UBX-CFG-GNSS message and command
+ubxcommands<> commands;         // configuration commands waiting for the receiver to ACK them
 
-// Send a byte to the receiver, defined here to keep the library hardware independent
-void sendByte(byte b)
+// Called while looking for the receiver's baud rate to set ours
+void setBaud( uint32_t rate, void *context )
 {
-  gpsSerial.write( b );
+  gpsSerial.updateBaudRate( rate );
 }
 
-// Send the packet specified to the receiver, here for the same reason as above
-void sendPacket(byte *packet, byte len)
+ubxbaud baud( 115200, setBaud );  // finds the receiver whatever rate it was left at and moves it to 115200
+
+// Send the packet specified to the receiver, defined here to keep the library
+// hardware independent. The library hands over whole frames so one write will do.
+void sendPacket( const byte *packet, uint16_t len )
+{
+  gpsSerial.write( packet, len );
+}
+
+// Called by the parser every time a UBX-NAV-PVT message is received
+void showNavPvt( navpvt8 &nav )
+{
+  // There are all kinds of goodies in the UBX-NAV-PVT message
+  Serial.println( nav.getnumSV() );
+  Serial.print( nav.getlat(), 5 );
+  Serial.print( " ");
+  Serial.print( nav.getlon(), 5 );
+  Serial.print( " ");
+  Serial.println( nav.getheight(), 2 );
+  Serial.print( nav.getpDOP(), 2 );
+  Serial.print( " ");
+  Serial.print( nav.gethAcc() );
+  Serial.print( " ");
+  Serial.println( nav.getvAcc() );
+  Serial.print( nav.getnano() );
+  Serial.print( " ");
+  Serial.println( nav.gettacc() );  // this is the estimated timing accuracy in nanoseconds
+  Serial.println( nav.getflags(), 16 );
+
+  // Here is how to get UTC of the timepulse to the nanosecond, date and all,
+  // without a double in sight
+  int64_t ns;
+  if( nav.getunixnano( ns ) )
+  {
+    char temp[40];
+    int32_t day = ns / ( 86400 * ubxnsps );
+    int64_t tod = ns - day * 86400 * ubxnsps;
+    int32_t sec = tod / ubxnsps;
+
+    sprintf( temp, "day %ld %02ld:%02ld:%02ld.%09ld", (long)day, (long)( sec / 3600 ), (long)( sec / 60 % 60 ),
+      (long)( sec % 60 ), (long)( tod % ubxnsps ) );
+    Serial.println( temp );
+  }
+}
+
+// Called by the command queue when the receiver answers a command (or doesn't)
+void onReply( uint32_t ticket, uint8_t cl, uint8_t id, Reply reply, void *context )
 {
-  for (byte i = 0; i < len; i++)
+  if( reply != Reply::ack )
   {
-      gpsSerial.write( packet[i] );
+    Serial.print( "command " );
+    Serial.print( cl, 16 );
+    Serial.print( " " );
+    Serial.print( id, 16 );
+    Serial.println( reply == Reply::nak ? " refused" : " not answered" );
   }
 }
 
@@ -30,68 +78,36 @@ void setup()
 {
   Serial.begin( 115200 );                        // for the console on USB (port 1)
 
-  // Initialize the ESP32 second port on pins 15 & 16
-  gpsSerial.begin( 9600, SERIAL_8N1, 15, 16 );   // remember that the receiver defaults to 9600 baud
+  // Initialize the ESP32 second port on pins 15 & 16. The rate doesn't matter, baud sets it
+  gpsSerial.begin( 9600, SERIAL_8N1, 15, 16 );
 
-  delay( 100 );
+  gps.on<navpvt8>( showNavPvt );  // the parser will call this when a UBX-NAV-PVT message is received
+  gps.attach( commands );         // so the command queue sees the ACKs
 
-  changeBaudrate( 115200 );  // tell the receiver to use 115200 baud (hard coded to 115200 right now)
-  delay( 100 );
-
-  gpsSerial.begin( 115200, SERIAL_8N1, 15, 16 );  // change our hardware serial port to 115200 baud
-  delay( 100 );
-
-  gpsSerial.flush();    // this eliminates receiving a lot of junk, probably not necessary
-  delay( 100 );
-
-  disableNmea();      // NMEA is the receiver’s default and clutters things especially when debugging.
-  delay( 100 );
-
-  enableNavPvt();    // Finally our command to periodically get the UBX-NAV-PVT message
-  delay( 100 );
+  // These are sent from loop() once the baud rate is sorted out, each one as
+  // soon as the receiver ACKs the one before
+  commands.onreply( onReply );
+  commands.add<cfgnmeaoff>();     // NMEA is the receiver’s default and clutters things especially when debugging.
+  commands.add<cfgnavpvton>();    // Finally our command to periodically get the UBX-NAV-PVT message
 }
 
 void loop()
 {
-  while( gpsSerial.available() )
+  uint8_t chunk[128];
+
+  while( int n = gpsSerial.available() )
   {
-    uint8_t c = gpsSerial.read();
-
-    char *r = (char *)gps.parse( c );
-
-    if( strlen( r ) > 0 )  // the parser will return the name of the message when one is received
-    {
-      if( strcmp( r, "navpvt8" ) == 0 )
-      {    // There are all kinds of goodies in the UBX-NAV-PVT message
-        Serial.println( nav.getnumSV() );
-        Serial.print( nav.getlat(), 5 );
-        Serial.print( " ");
-        Serial.print( nav.getlon(), 5 );
-        Serial.print( " ");
-        Serial.println( nav.getheight(), 2 );
-        Serial.print( nav.getpDOP(), 2 );
-        Serial.print( " ");
-        Serial.print( nav.gethAcc() );
-        Serial.print( " ");
-        Serial.println( nav.getvAcc() );
-        Serial.print( nav.getnano() );
-        Serial.print( " ");
-        Serial.println( nav.gettacc() );  // this is the estimated timing accuracy in nanoseconds
-        Serial.println( nav.getflags(), 16 );
-
-        // Here is how to caculate UTC of the timepulse to the nanosecond!
-        // It really should be extended to include days, months and year...
-        double sec = 3600.0 * nav.gethour() + 60.0 * nav.getminute() + 1.0 * nav.getsecond() + nav.getnano() * 1e-9;
-        int hr = sec / 3600;
-        int mn = (sec - hr * 3600) / 60;
-        double sc = sec - hr * 3600 - mn * 60;
-
-        Serial.print( hr );
-        Serial.print( ":" );
-        Serial.print( mn );
-        Serial.print( ":" );
-        Serial.println( sc, 9 );
-      }
-    }
+    if( n > (int)sizeof( chunk ) )
+      n = sizeof( chunk );
+
+    n = gpsSerial.readBytes( chunk, n );
+
+    if( !baud.isdone() )
+      baud.feed( chunk, n );  // it needs to see whether the receiver makes sense at this rate
+
+    gps.parse( chunk, n );  // hand the parser everything we have in one go
   }
+
+  if( baud.update( millis() ) )
+    commands.update( millis() );
 }
@@ -74,47 +74,237 @@ const char* password =  "";
 
 HardwareSerial gpsSerial( 1 );
 
+void setBaud( uint32_t rate, void *context )
+{
+  gpsSerial.updateBaudRate( rate );
+}
+
+ubxbaud baud( 115200, setBaud );
+
 ublox gps;
-navpvt8 nav( gps );
-cfgtp5 tp( gps );
-navsat ns( gps );
-cfggnss gc( gps );
+ubxcommands<> commands;
+ubxpolls<> polls;
+ubxconfig<> config( polls, commands );
 
 // these are things we are going to display so keep them global
 int satTypes[7];
 double snr;
-double sec;
 int hr;
 int mn;
-double sc;
+int sc;
+int32_t nsec;
 int numSV;
 double pDOP;
 uint32_t flags;
 int tacc;
+uint32_t ckerrors = 0;
 
 // Initialize the OLED display
 SSD1306  display( 0x3c, 5, 4 ); // Wemos board
 //SSD1306 display (0x3c, 4, 15); // TTGO with LoRa
 
 
-// Send a byte to the receiver
-void sendByte(byte b)
+// Send the packet specified to the receiver
+void sendPacket( const byte *packet, uint16_t len )
 {
-  gpsSerial.write( b );
+  gpsSerial.write( packet, len );
 }
 
-// Send the packet specified to the receiver
-void sendPacket(byte *packet, byte len)
+void displayStatusMessage( int line, char *msg )
+{
+  display.drawString( 0, line * 16, msg );
+}
+
+// These are called with the packets of each navigation solution
+
+void onNavPvt( navpvt8 &nav )
 {
-  for (byte i = 0; i < len; i++)
+#if SERIALDEBUG
+  Serial.println( nav.getnumSV() );
+  Serial.print( nav.getlat(), 5 );
+  Serial.print( " ");
+  Serial.print( nav.getlon(), 5 );
+  Serial.print( " ");
+  Serial.println( nav.getheight(), 2 );
+  Serial.print( nav.getpDOP(), 2 );
+  Serial.print( " ");
+  Serial.print( nav.gethAcc() );
+  Serial.print( " ");
+  Serial.println( nav.getvAcc() );
+  Serial.print( nav.getnano() );
+  Serial.print( " ");
+  Serial.println( nav.gettacc() );
+  Serial.println( nav.getflags(), 16 );
+#endif
+  int64_t ns;
+  if( nav.getunixnano( ns ) )
   {
-      gpsSerial.write( packet[i] );
+    int64_t tod = ns % ( 86400 * ubxnsps );
+    int32_t sec = tod / ubxnsps;
+
+    hr = sec / 3600;
+    mn = sec / 60 % 60;
+    sc = sec % 60;
+    nsec = tod % ubxnsps;
   }
+
+  numSV = nav.getnumSV();
+  pDOP = nav.getpDOP();
+  flags = nav.getflags();
+  tacc =  nav.gettacc();
 }
 
-void displayStatusMessage( int line, char *msg )
+// The configuration cache calls these with a copy of the receiver's
+// current settings, anything changed here is sent back
+
+void setUbxOnly( cfgprt &prt, void *context )
 {
-  display.drawString( 0, line * 16, msg );
+  prt.setOutProtoMask( 1 );  // no NMEA out of our port
+}
+
+void setTimePulse( cfgtp5 &tp, void *context )
+{
+#if SERIALDEBUG
+  Serial.print( tp.getAntCableDelay() );
+  Serial.print( " ");
+  Serial.println( tp.getRfGroupDelay() );
+
+  Serial.print( tp.getFreqPeriod() );
+  Serial.print( " ");
+  Serial.println( tp.getFreqPeriodLock() );
+
+  Serial.print( tp.getPulseLenRatio() );
+  Serial.print( " ");
+  Serial.println( tp.getPulseLenRatioLock() );
+
+  Serial.print( tp.getUserConfigDelay() );
+  Serial.print( " ");
+  Serial.println( tp.getFlags(), 16 );
+
+  Serial.println( "Configure time pulse parameters" );
+#endif
+  //Serial.println( "Configure time pulse parameters" );
+  // Here we set our time pulse parameters
+  tp.setPulseLenRatio( 500000 );
+}
+
+void onNavSat( navsat &ns )
+{
+  int numsvs = ns.getnumSvs();
+#if SERIALDEBUG
+  Serial.print( "Num SVs: ");
+  Serial.println( numsvs );
+#endif
+  for( int i = 0; i < 7; i++ )
+    satTypes[i] = 0;
+
+  snr = 0.0; // average snr
+  int c = 0;
+
+  for( int i = 0; i < numsvs; i++ )
+  {
+    int flags = (int)ns.getflags( i );
+
+    if( flags & 8 )
+    {
+      c++;
+      snr += 1.0 * ns.getcno( i );
+
+      int gnssId = (int)ns.getgnssId( i );
+      if( gnssId < 7 && gnssId >= 0 )
+        satTypes[gnssId]++;
+
+#if SERIALDEBUG
+      Serial.print( gnssId );
+      Serial.print( " " );
+      Serial.print( (int)ns.getsvId( i ) );
+      Serial.print( " " );
+      Serial.print( (int)ns.getcno( i ) );
+      Serial.print( " " );
+      Serial.print( flags, 16 );
+      Serial.print( "   " );
+#endif
+    }
+  }
+
+  if( c > 0 )
+    snr = snr / c;
+
+#if SERIALDEBUG
+  Serial.println( snr );
+#endif
+}
+
+void updateDisplay()
+{
+  display.clear();
+
+  char temp[40];
+
+  sprintf( temp, "SV:%2.2d  PD:%2.2f", numSV, pDOP );
+  displayStatusMessage( 0, temp );
+#if SOCKETSERVER
+  sprintf( temp, "0:%2.2d 6:%2.2d S:%3.1f", satTypes[0], satTypes[6], snr );
+  displayStatusMessage( 1, temp );
+#else
+  displayStatusMessage( 1, deltaPPS );
+#endif
+  sprintf( temp, "%2.2d:%2.2d:%2.2d.%06ld", hr, mn, sc, (long)( nsec / 1000 ) );
+  displayStatusMessage( 2, temp );
+
+  sprintf( temp, "f:%X ns: %d ck: %d", flags, tacc, ckerrors );
+  //sprintf( temp, "%2.2d:%2.2d:%2.2d", nav.gethour(), nav.getminute(), nav.getsecond() );
+  //static int count = 0;
+  //sprintf( temp, "%d", count++ );
+  displayStatusMessage( 3, temp );
+
+  display.display();
+}
+
+// The epoch assembler calls this once per navigation solution, with the
+// NAV-PVT and NAV-SAT of that solution. *** NOTE we update the OLED display
+// here. The OLED takes around 20ms to update and we can get serial buffer
+// overflows (and therefore lost packets) if we try to do it somewhere
+// else. We could move it back to the main loop and have flags to see that
+// the serial buffer is empty before updating...
+
+void onEpoch( const ubxepoch<navpvt8, navsat> &epoch, void *context )
+{
+  if( epoch.has<navpvt8>() )
+  {
+    navpvt8 nav = epoch.get<navpvt8>();
+    onNavPvt( nav );
+  }
+
+  if( epoch.has<navsat>() )
+  {
+    navsat ns = epoch.get<navsat>();
+    onNavSat( ns );
+  }
+
+  updateDisplay();
+}
+
+ubxepoch<navpvt8, navsat> epoch( onEpoch );
+
+void setGnss( cfggnss &gc, void *context )
+{
+  //Serial.print( "Num Blocks: ");
+  int numblocks = gc.getnumConfigBlocks();
+  //Serial.println( numblocks );
+
+  for( int i = 0; i < numblocks; i++ )
+  {
+    int gnssId = (int)gc.getgnssId(i);
+
+    //Serial.print( gnssId );
+    //Serial.print( " " );
+    //Serial.print( (int)gc.getFlags(i), 16 );
+    //Serial.print( " " );
+
+    if( gnssId == 1 )
+      gc.setFlags( i, gc.getFlags( i ) & ~1 );  // Disable SBAS
+  }
 }
 
 void setup()
@@ -149,25 +339,20 @@ void setup()
   wifiServer.setNoDelay(true);
 #endif
 
-  delay( 4000 );
-  changeBaudrate( 115200 );  // change to 115200
-
-  delay( 100 );
-  gpsSerial.begin( 115200, SERIAL_8N1, 15, 16 );
+  gps.attach( commands );
+  gps.attach( polls );
 
-  delay( 100 );
-  gpsSerial.flush();
+  // Checked from loop() once baud has the receiver at 115200, a receiver
+  // that kept its configuration only gets the polls
+  config.change<cfgprt>( setUbxOnly );
+  config.message( _navpvt8hdr::cl, _navpvt8hdr::id, 1 );
+  config.message( _navsathdr::cl, _navsathdr::id, 1 );
+  config.message( _naveoehdr::cl, _naveoehdr::id, 1 );
+  config.change<cfgtp5>( setTimePulse );
+  config.change<cfggnss>( setGnss );
+  config.apply();
 
-  delay( 100 );
-  disableNmea();
-
-  delay( 100 );
-  enableNavPvt();
-
-  delay( 100 );
-  enableNavSat();
-
-  delay( 100 );
+  gps.attach( epoch );
 
 #if SERIALDEBUG
   Serial.println( "u-blox initialized" );
@@ -180,8 +365,6 @@ void setup()
 
 void loop()
 {
-  static uint32_t ckerrors = 0;
-
   static uint32_t lastPpsCount = ppsCount;
 
   if( (ppsCount != lastPpsCount) && !digitalRead( interruptPin ) )
@@ -221,10 +404,7 @@ void loop()
       if( b == '\r' )
       {
         char temp[40];
-        if( sc < 10.0 )
-          sprintf( temp, " %2.2d:%2.2d:0%2.9f", hr, mn, sc );
-        else
-          sprintf( temp, " %2.2d:%2.2d:%2.9f", hr, mn, sc );
+        sprintf( temp, " %2.2d:%2.2d:%2.2d.%09ld", hr, mn, sc, (long)nsec );
 
         client.write( temp );
 
@@ -268,179 +448,27 @@ void loop()
   }
 #endif
 
-  // The following flags are for polling because it seems that a few
-  // requests might be needed to get a response. So poll until we get one!
-  static bool waitForCfgtp5 = true; // for config of the time pulse
-  static bool waitForCfgGnss = true;// and the GNSS configuration (to disable SBAS)
+  uint8_t chunk[128];
 
-  while( gpsSerial.available() )
+  while( int n = gpsSerial.available() )
   {
-    uint8_t c = gpsSerial.read();
-
-    char *r = (char *)gps.parse( c );
-
-    if( strlen( r ) > 0 )
-    {
-      if( strcmp( r, "navpvt8" ) == 0 )
-      {
-        if( waitForCfgtp5 )
-        {
-          pollTimePulseParameters();  // ask for the current time pulse parameters then we will set them
-        }
-        else if( waitForCfgGnss )
-        {
-          gc.pollCfggnss();           // same for the gnss configuration
-        }
-#if SERIALDEBUG
-        Serial.println( nav.getnumSV() );
-        Serial.print( nav.getlat(), 5 );
-        Serial.print( " ");
-        Serial.print( nav.getlon(), 5 );
-        Serial.print( " ");
-        Serial.println( nav.getheight(), 2 );
-        Serial.print( nav.getpDOP(), 2 );
-        Serial.print( " ");
-        Serial.print( nav.gethAcc() );
-        Serial.print( " ");
-        Serial.println( nav.getvAcc() );
-        Serial.print( nav.getnano() );
-        Serial.print( " ");
-        Serial.println( nav.gettacc() );
-        Serial.println( nav.getflags(), 16 );
-#endif
-        sec = 3600.0 * nav.gethour() + 60.0 * nav.getminute() + 1.0 * nav.getsecond() + nav.getnano() * 1e-9;
-        hr = sec / 3600;
-        mn = (sec - hr * 3600) / 60;
-        sc = sec - hr * 3600 - mn * 60;
-
-        numSV = nav.getnumSV();
-        pDOP = nav.getpDOP();
-        flags = nav.getflags();
-        tacc =  nav.gettacc();
-      }
-      else if( strcmp( r, "cfgtp5" ) == 0 )
-      {
-#if SERIALDEBUG
-        Serial.print( tp.getAntCableDelay() );
-        Serial.print( " ");
-        Serial.println( tp.getRfGroupDelay() );
-
-        Serial.print( tp.getFreqPeriod() );
-        Serial.print( " ");
-        Serial.println( tp.getFreqPeriodLock() );
+    if( n > (int)sizeof( chunk ) )
+      n = sizeof( chunk );
 
-        Serial.print( tp.getPulseLenRatio() );
-        Serial.print( " ");
-        Serial.println( tp.getPulseLenRatioLock() );
+    n = gpsSerial.readBytes( chunk, n );
 
-        Serial.print( tp.getUserConfigDelay() );
-        Serial.print( " ");
-        Serial.println( tp.getFlags(), 16 );
-
-        Serial.println( "Configure time pulse parameters" );
-#endif
-        //Serial.println( "Configure time pulse parameters" );
-        // Here we set our time pulse parameters
-        tp.setPulseLenRatio( 500000 );
-        tp.configureTimePulse();
+    if( !baud.isdone() )
+      baud.feed( chunk, n );
 
-        waitForCfgtp5 = false; // only need to do it once
-      }
-      else if( strcmp( r, "navsat" ) == 0 )
-      {
-        int numsvs = ns.getnumSvs();
-#if SERIALDEBUG
-        Serial.print( "Num SVs: ");
-        Serial.println( numsvs );
-#endif
-        for( int i = 0; i < 7; i++ )
-          satTypes[i] = 0;
-
-        snr = 0.0; // average snr
-        int c = 0;
-
-        for( int i = 0; i < numsvs; i++ )
-        {
-          int flags = (int)ns.getflags( i );
-
-          if( flags & 8 )
-          {
-            c++;
-            snr += 1.0 * ns.getcno( i );
-
-            int gnssId = (int)ns.getgnssId( i );
-            if( gnssId < 7 && gnssId >= 0 )
-              satTypes[gnssId]++;
-
-#if SERIALDEBUG
-            Serial.print( gnssId );
-            Serial.print( " " );
-            Serial.print( (int)ns.getsvId( i ) );
-            Serial.print( " " );
-            Serial.print( (int)ns.getcno( i ) );
-            Serial.print( " " );
-            Serial.print( flags, 16 );
-            Serial.print( "   " );
-#endif
-          }
-        }
-
-        if( c > 0 )
-          snr = snr / c;
-
-#if SERIALDEBUG
-        Serial.println( snr );
-#endif
-        // *** NOTE we update the OLED display here right after the NAV-SAT
-        // message is received. The OLED takes around 20ms to update and
-        // we can get serial buffer overflows (and therefore lost packets)
-        // if we try to do it somewhere else. We could move it back to the
-        // main loop and have flags to see that packets have been received
-        // and that the serial buffer is empty before updating...
-        display.clear();
-
-        char temp[40];
-
-        sprintf( temp, "SV:%2.2d  PD:%2.2f", numSV, pDOP );
-        displayStatusMessage( 0, temp );
-#if SOCKETSERVER
-        sprintf( temp, "0:%2.2d 6:%2.2d S:%3.1f", satTypes[0], satTypes[6], snr );
-        displayStatusMessage( 1, temp );
-#else
-        displayStatusMessage( 1, deltaPPS );
-#endif
-        sprintf( temp, "%2.2d:%2.2d:%f", hr, mn, sc );
-        displayStatusMessage( 2, temp );
-
-        sprintf( temp, "f:%X ns: %d ck: %d", flags, tacc, ckerrors );
-        //sprintf( temp, "%2.2d:%2.2d:%2.2d", nav.gethour(), nav.getminute(), nav.getsecond() );
-        //static int count = 0;
-        //sprintf( temp, "%d", count++ );
-        displayStatusMessage( 3, temp );
-
-        display.display();
-      }
-      else if( strcmp( r, "cfggnss" ) == 0 )
-      {
-        //Serial.print( "Num Blocks: ");
-        int numblocks = gc.getnumConfigBlocks();
-        //Serial.println( numblocks );
-
-        for( int i = 0; i < numblocks; i++ )
-        {
-          int gnssId = (int)gc.getgnssId(i);
-
-          //Serial.print( gnssId );
-          //Serial.print( " " );
-          //Serial.print( (int)gc.getFlags(i), 16 );
-          //Serial.print( " " );
+    gps.parse( chunk, n );
+  }
 
-          if( gnssId == 1 )
-            gc.setCfggnss( 1, false );  // Disable SBAS
-        }
+  uint32_t now = millis();
 
-        waitForCfgGnss = false;
-      }
-    }
+  if( baud.update( now ) )
+  {
+    config.update( now );
+    commands.update( now );
+    polls.update( now );
   }
 }
@@ -8,15 +8,27 @@
 #ifndef ubloxm8_h
 #define ubloxm8_h
 
-#define MAXBUFFERSIZE 1024  // using this to define the maximum buffer size
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
 
-extern void sendByte(byte b);
-extern void sendPacket(byte *packet, byte len);
+#ifndef MAXBUFFERSIZE
+#define MAXBUFFERSIZE 1024  // the largest buffer a parser may have, raise it for long messages
+#endif
+
+// Everything sent to the receiver goes through here, one whole frame (or
+// several) per call
+extern void sendPacket( const byte *packet, uint16_t len );
 
 const double mm2m = 1.0e-3;
 const double en7 = 1.0e-7;
 const double en5 = 1.0e-5;
 
+// Every packet the parser can return. parse() gives one of these back
+// instead of a name so there are no strings to compare.
+enum class Message : uint8_t { none, navpvt7, navpvt8, cfgtp5, ack, nak, navsat, cfggnss, cfgmsg, cfgprt, cfgnav5, cfgrate, rxmrawx, rxmsfrbx, naveoe };
+
 struct _header
 {
   uint8_t   cl;
@@ -30,14 +42,16 @@ struct _header
 
 struct _navpvt7hdr
 {
-  uint8_t   cl = 0x01;
-  uint8_t   id = 0x07;
-  uint16_t  length = 84;
+  static constexpr uint8_t   cl = 0x01;
+  static constexpr uint8_t   id = 0x07;
+  static constexpr uint16_t  length = 84;
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::navpvt7;
 };
 
 typedef struct
 {
-  _navpvt7hdr header;
+  _header header;
   uint32_t  iTOW;
   uint16_t  year;
   uint8_t   month;
@@ -66,22 +80,23 @@ typedef struct
   uint32_t  sAcc;
   uint32_t  headAcc;
   uint16_t  pDOP;
-  uint8_t   reserved[6];
-  int32_t		headVeh;
+  uint8_t   reserved[6];  // the u-blox 7 packet ends here, it has no headVeh
 } _navpvt7;
 
 // u-blox 8 nav-pvt packet
 
 struct _navpvt8hdr
 {
-  uint8_t   cl = 0x01;
-  uint8_t   id = 0x07;
-  uint16_t  length = 92;
+  static constexpr uint8_t   cl = 0x01;
+  static constexpr uint8_t   id = 0x07;
+  static constexpr uint16_t  length = 92;
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::navpvt8;
 };
 
 typedef struct   // u-blox 8
 {
-  _navpvt8hdr header;
+  _header header;
   uint32_t  iTOW;
   uint16_t  year;
   uint8_t   month;
@@ -120,14 +135,16 @@ typedef struct   // u-blox 8
 
 struct _cfgtp5hdr
 {
-  uint8_t   cl = 0x06;
-  uint8_t   id = 0x31;
-  uint16_t  length = 32; // make this 0 for command to poll (not supporting TIMEPULSE2)
+  static constexpr uint8_t   cl = 0x06;
+  static constexpr uint8_t   id = 0x31;
+  static constexpr uint16_t  length = 32; // make this 0 for command to poll (not supporting TIMEPULSE2)
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::cfgtp5;
 };
 
 typedef struct   // u-blox 8 configure time pulse
 {
-  _cfgtp5hdr header;
+  _header header;
   uint8_t   tpIdx;    // 0 = TIMEPULSE, 1 = TIMEPULSE2
   uint8_t   version;  // 0 for this version
   uint16_t  reserved;
@@ -143,37 +160,45 @@ typedef struct   // u-blox 8 configure time pulse
 
 struct _ackhdr
 {
-  uint8_t   cl = 0x05;
-  uint8_t   id = 0x01;
-  uint16_t  length = 2;
+  static constexpr uint8_t   cl = 0x05;
+  static constexpr uint8_t   id = 0x01;
+  static constexpr uint16_t  length = 2;
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::ack;
 };
 
 typedef struct
 {
-  _ackhdr header;
+  _header header;
   uint8_t   clsId;  // Class ID of the Acknowledged Message
   uint8_t   msgId;  // Message ID of the Acknowledged Message
 } _ack;
 
 struct _nakhdr
 {
-  uint8_t   cl = 0x05;
-  uint8_t   id = 0x00;
-  uint16_t  length = 2;
+  static constexpr uint8_t   cl = 0x05;
+  static constexpr uint8_t   id = 0x00;
+  static constexpr uint16_t  length = 2;
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::nak;
 };
 
 typedef struct
 {
-  _nakhdr header;
+  _header header;
   uint8_t clsId;  // Class ID of the Not-Acknowledged Message
   uint8_t msgId;  // Message ID of the Not-Acknowledged Message
 } _nak;
 
 struct _navsathdr
 {
-  uint8_t   cl = 0x01;
-  uint8_t   id = 0x35;
-  uint16_t  length = 0;  // this is a variable length message
+  static constexpr uint8_t   cl = 0x01;
+  static constexpr uint8_t   id = 0x35;
+  static constexpr uint16_t  length = 0;  // this is a variable length message
+  static constexpr uint16_t  maxlength = 8 + 12 * 84; // the most satellites that fit in the 1K buffer
+  static constexpr Message   message = Message::navsat;
+  static constexpr uint16_t  introsize = 8;   // for streaming, see ubxparser::stream()
+  static constexpr uint16_t  blocksize = 12;
 };
 
 struct _navsatintro
@@ -197,16 +222,19 @@ struct _navsatblock
 
 typedef struct
 {
-  _navsathdr header;
+  _header header;
   _navsatintro intro;
-  _navsatblock block[0];  // this will be variable length, there is lots of room in the 1K buffer
-} _navsat;  // this is the received message
+} _navsat;  // this is the received message, numSvs blocks follow the intro
 
 struct _cfggnsshdr
 {
-  uint8_t   cl = 0x06;
-  uint8_t   id = 0x3E;
-  uint16_t  length = 0;  // this is a variable length message
+  static constexpr uint8_t   cl = 0x06;
+  static constexpr uint8_t   id = 0x3E;
+  static constexpr uint16_t  length = 0;  // this is a variable length message
+  static constexpr uint16_t  maxlength = 4 + 8 * 7;   // one block per GNSS
+  static constexpr Message   message = Message::cfggnss;
+  static constexpr uint16_t  introsize = 4;
+  static constexpr uint16_t  blocksize = 8;
 };
 
 struct _cfggnssintro
@@ -228,802 +256,4689 @@ struct _cfggnssblock
 
 typedef struct
 {
-  _cfggnsshdr header;
+  _header header;
   _cfggnssintro intro;
-  _cfggnssblock block[0];  // this will be variable length, there is lots of room in the 1K buffer
-} _cfggnss;  // this is the received message
-
-//Declare a buffer for every packet we know about. We are only going
-//to load those packets.
-typedef union
-{
-    _navpvt7 navpvt7;
-    _navpvt8 navpvt8;
-    _cfgtp5  cfgtp5;
-    _nak nak;
-    _ack ack;
-    _navsat navsat;
-    _cfggnss cfggnss;
-    byte data[MAXBUFFERSIZE]; // I added this because you can't predict the size of variable length messages...
-} _buf;
-
-// This is a declaration of packets we know about. We are only going to load those
-struct _navpvt7hdr navpvt7hdr;
-struct _navpvt8hdr navpvt8hdr;
-struct _cfgtp5hdr  cfgtp5hdr;
-struct _ackhdr     ackhdr;
-struct _nakhdr     nakhdr;
-struct _navsathdr  navsathdr;
-struct _cfggnsshdr cfggnsshdr;
-
-// Array of packet headers and array of packet names
-struct _header *packetheaders[] = { (struct _header *)&navpvt7hdr, (struct _header *)&navpvt8hdr, \
-  (struct _header *)&cfgtp5hdr, (struct _header *)&ackhdr, (struct _header *)&nakhdr, \
-  (struct _header *)&navsathdr, (struct _header *)&cfggnsshdr };
-
-const char *packetnames[] = { "navpvt7", "navpvt8", "cfgtp5", "ack", "nak", "navsat", "cfggnss" };
-
-enum class State { sync1, sync2, header, payload, check };
-
-/*
-  This is the class for parsing incoming packets. It uses a state-machine
-  approach and the method parse() expects a single byte for input.
-  Parse() returns the name of the packet on completion or a null drawString
-  otherwise.
+} _cfggnss;  // this is the received message, numConfigBlocks blocks follow the intro
 
-  Parse uses Arduino type Strings.
-*/
+// The rest of the configuration that ubxconfig keeps track of. These are
+// the layouts the receiver replies to a poll with.
 
-class ublox
+struct _cfgmsghdr
 {
-  public:
-    ublox()
-    {
-        state = State::sync1;
-        count = 0;
-        checksumerrors = 0;
-    };
-
-    const char *parse( uint8_t c )
-    {
-      uint8_t *p = (uint8_t *)&buffer;
-
-      switch( state )
-      {
-        case State::sync1:
-        {
-          count = 0;
-          result = (char *)"";
-
-          if( c == 0xB5 )
-          {
-            count++;
-            state = State::sync2;
-          }
-        }
-        break;
-
-        case State::sync2:
-        {
-          if( c == 0x62 )
-          {
-            count++;
-            state = State::header;
-          }
-          else
-          {
-            state = State::sync1;
-          }
-        }
-        break;
-
-        case State::header:
-          if( count < 6 )
-          {
-            p[ count++ - 2 ] = c; // note: we are not putting the sync bytes in the buffer
-          }
-          else
-          {
-            p[ count++ - 2 ] = c; // don't lose the incoming byte!
-            struct _header *packetheader = (_header *)p;
-
-            for( unsigned int i = 0; i < sizeof( packetheaders) / sizeof( void * ); i++ )
-            {
-              struct _header *h = (struct _header *)packetheaders[i];
-
-              // can't always check packetlength because some packets have unknown length (set as 0)
-              if( h->cl == packetheader->cl && h->id == packetheader->id && (h->length == packetheader->length || h->length == 0) )
-              {
-                result = (char *)packetnames[i]; // this will be the packet if there are no errors
-                length = packetheader->length;
-                payload_p = &(p[4]);
-                state = State::payload; // this will only change if we have a packet we know about
-                break; // don't need to look any farther once we find one
-              }
-            }
-
-            if( state == State::payload ) // were we successfull?
-            {
-              // Nothing to do here for now...
-            }
-            else
-            {
-              state = State::sync1;
-            }
-          }
-          break;
-
-        case State::payload:
-        {
-          if( count < length + 6 )
-          {
-            p[ count++ - 2 ] = c;
-          }
-          else
-          {
-            // The checksum is over the header plus the payload
-            calculatechecksum( checksum, payload_p - 4, length + 4 );
-
-            if( checksum[0] == c ) // check the first checksum byte
-              state = State::check;
-            else
-            {
-              checksumerrors++;
-              state = State::sync1;
-            }
-          }
-        }
-        break;
-
-        case State::check:
-        {
-          if( c == checksum[1] )
-          {
-            state = State::sync1; // set to look at next packet
-            return result; // return our result!
-          }
-          else
-          {
-            checksumerrors++;
-            state = State::sync1;
-          }
-        }
-        break;
-      }
-
-      return "";
-    };
-
-    uint8_t *getbuffer()
-    {
-      return buffer;
-    };
-
-  	void calculatechecksum( uint8_t *ck, uint8_t *payload, uint16_t length )
-    {
-      ck[0] = 0;
-      ck[1] = 0;
-
-      for( uint16_t i = 0; i < length; i++ )
-      {
-            ck[0] += payload[i];
-            ck[1] += ck[0];
-      }
-    };
-
-    uint32_t getchecksumerrors()
-    {
-      return checksumerrors;
-    }
-
-    uint8_t checksum[2];
-    State state;
-    uint16_t count;
-    uint16_t length;
-    uint8_t *payload_p;
-    char *result = (char *)"";
-    uint8_t buffer[sizeof(_buf)];
-    uint32_t checksumerrors; // this is to help look for buffer problems...
+  static constexpr uint8_t   cl = 0x06;
+  static constexpr uint8_t   id = 0x01;
+  static constexpr uint16_t  length = 8;  // the rate on every port, setting it can also be 3 bytes
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::cfgmsg;
 };
 
-class navpvt7
+typedef struct
 {
-  public:
-    navpvt7( ublox &gps )
-    {
-      buffer = gps.getbuffer();
-    };
-
-    int32_t getnano() { return ((_navpvt7 *)buffer)->nano; }
-    uint8_t getnumSV() { return ((_navpvt7 *)buffer)->numSV; }
-    double getlon() { return ((_navpvt7 *)buffer)->lon * en7; }
-    double getlat() { return ((_navpvt7 *)buffer)->lat * en7; }
-    double getheight() { return ((_navpvt7 *)buffer)->height * mm2m; }
-    double gethAcc() { return ((_navpvt7 *)buffer)->hAcc * mm2m; }
-    double getvAcc() { return ((_navpvt7 *)buffer)->vAcc * mm2m; }
-    double getpDOP() { return ((_navpvt7 *)buffer)->pDOP * 0.01L; }
+  _header header;
+  uint8_t   msgClass;
+  uint8_t   msgId;
+  uint8_t   rate[6];  // per port: DDC, UART1, UART2, USB, SPI, reserved
+} _cfgmsg;
 
-  private:
-    uint8_t *buffer;
+struct _cfgprthdr
+{
+  static constexpr uint8_t   cl = 0x06;
+  static constexpr uint8_t   id = 0x00;
+  static constexpr uint16_t  length = 20;
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::cfgprt;
 };
 
-class navpvt8
+typedef struct   // UART layout, the other ports use mode and baudRate differently
 {
-  public:
-    navpvt8( ublox &gps )
-    {
-      buffer = gps.getbuffer();
-    };
-
-    uint32_t gettacc() { return ((_navpvt8 *)buffer)->tAcc; }
-    uint8_t getnumSV() { return ((_navpvt8 *)buffer)->numSV; }
-    double getlon() { return ((_navpvt8 *)buffer)->lon * en7; }
-    double getlat() { return ((_navpvt8 *)buffer)->lat * en7; }
-    double getheight() { return ((_navpvt8 *)buffer)->height * mm2m; }
-    double gethAcc() { return ((_navpvt8 *)buffer)->hAcc * mm2m; }
-    int32_t getvAcc() { return ((_navpvt8 *)buffer)->vAcc; }
-    double getpDOP() { return ((_navpvt8 *)buffer)->pDOP * 0.01L; }
-    uint8_t getflags() { return ((_navpvt8 *)buffer)->flags; }
-    uint16_t getyear() { return ((_navpvt8 *)buffer)->year; }
-    uint8_t getmonth() { return ((_navpvt8 *)buffer)->month; }
-    uint8_t getday() { return ((_navpvt8 *)buffer)->day; }
-    uint8_t gethour() { return ((_navpvt8 *)buffer)->hour; }
-    uint8_t getminute() { return ((_navpvt8 *)buffer)->min; }
-    uint8_t getsecond() { return ((_navpvt8 *)buffer)->sec; }
-    int32_t getnano() { return ((_navpvt8 *)buffer)->nano; }
-    double getgSpeed() { return ((_navpvt8 *)buffer)->gSpeed * 1.0; }
-    double getheadMot() { return ((_navpvt8 *)buffer)->headMot * en5; } // this one too
-
-  private:
-    uint8_t *buffer;
+  _header header;
+  uint8_t   portID;
+  uint8_t   reserved1;
+  uint16_t  txReady;
+  uint32_t  mode;
+  uint32_t  baudRate;
+  uint16_t  inProtoMask;  // 1 = UBX, 2 = NMEA, 4 = RTCM2, 0x20 = RTCM3
+  uint16_t  outProtoMask;
+  uint16_t  flags;
+  uint8_t   reserved2[2];
+} _cfgprt;
+
+struct _cfgnav5hdr
+{
+  static constexpr uint8_t   cl = 0x06;
+  static constexpr uint8_t   id = 0x24;
+  static constexpr uint16_t  length = 36;
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::cfgnav5;
 };
 
-class cfgtp5
+typedef struct
 {
-  public:
-    cfgtp5( ublox &gps )
-    {
-      buffer = gps.getbuffer();
-      _gps = gps;
-    };
-
-    uint16_t  getAntCableDelay() { return ((_cfgtp5 *)buffer)->antCableDelay; }
-    uint16_t  getRfGroupDelay() { return ((_cfgtp5 *)buffer)->rfGroupDelay; }
-    uint32_t  getFreqPeriod() { return ((_cfgtp5 *)buffer)->freqPeriod; }
-    uint32_t  getFreqPeriodLock() { return ((_cfgtp5 *)buffer)->freqPeriodLock; }
-    uint32_t  getPulseLenRatio() { return ((_cfgtp5 *)buffer)->pulseLenRatio; }
-    uint32_t  getPulseLenRatioLock() { return ((_cfgtp5 *)buffer)->pulseLenRatioLock; }
-    int32_t   getUserConfigDelay() { return ((_cfgtp5 *)buffer)->userConfigDelay; }
-    uint32_t  getFlags()  { return ((_cfgtp5 *)buffer)->flags; }
-
-    void setAntCableDelay( uint16_t  antCableDelay ) { ((_cfgtp5 *)buffer)->antCableDelay = antCableDelay; }
-    void setRfGroupDelay( uint16_t  rfGroupDelay ) { ((_cfgtp5 *)buffer)->rfGroupDelay = rfGroupDelay; }
-    void setFreqPeriod( uint32_t  freqPeriod ) { ((_cfgtp5 *)buffer)->freqPeriod = freqPeriod; }
-    void setFreqPeriodLock( uint32_t  freqPeriodLock ) { ((_cfgtp5 *)buffer)->freqPeriodLock = freqPeriodLock; }
-    void setPulseLenRatio( uint32_t  pulseLenRatio ) { ((_cfgtp5 *)buffer)->pulseLenRatio = pulseLenRatio; }
-    void setPulseLenRatioLock( uint32_t  pulseLenRatioLock ) { ((_cfgtp5 *)buffer)->pulseLenRatioLock = pulseLenRatioLock; }
-    void setUserConfigDelay( int32_t  userConfigDelay ) { ((_cfgtp5 *)buffer)->userConfigDelay = userConfigDelay; }
-    void setFlags( uint32_t  flags ) { ((_cfgtp5 *)buffer)->flags = flags; }
-
-    void configureTimePulse()
-    {
-      sendByte( 0xB5 );
-      sendByte( 0x62 );
-
-      sendPacket( buffer, cfgtp5hdr.length + 4 );
+  _header header;
+  uint16_t  mask;     // which parameters a set applies
+  uint8_t   dynModel;
+  uint8_t   fixMode;
+  int32_t   fixedAlt;
+  uint32_t  fixedAltVar;
+  int8_t    minElev;
+  uint8_t   drLimit;
+  uint16_t  pDop;
+  uint16_t  tDop;
+  uint16_t  pAcc;
+  uint16_t  tAcc;
+  uint8_t   staticHoldThresh;
+  uint8_t   dgnssTimeout;
+  uint8_t   cnoThreshNumSVs;
+  uint8_t   cnoThresh;
+  uint8_t   reserved1[2];
+  uint16_t  staticHoldMaxDist;
+  uint8_t   utcStandard;
+  uint8_t   reserved2[5];
+} _cfgnav5;
+
+struct _cfgratehdr
+{
+  static constexpr uint8_t   cl = 0x06;
+  static constexpr uint8_t   id = 0x08;
+  static constexpr uint16_t  length = 6;
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::cfgrate;
+};
 
-      uint8_t ck[2];
-      _gps.calculatechecksum( ck, buffer, cfgtp5hdr.length + 4 );
+typedef struct
+{
+  _header header;
+  uint16_t  measRate; // ms between measurements
+  uint16_t  navRate;  // measurements per solution
+  uint16_t  timeRef;  // 0 = UTC, 1 = GPS
+} _cfgrate;
 
-      sendPacket( ck, 2 );
-    }
+// End of epoch, the last of the NAV packets of a navigation solution
 
-  private:
-    uint8_t *buffer;
-    ublox _gps;
+struct _naveoehdr
+{
+  static constexpr uint8_t   cl = 0x01;
+  static constexpr uint8_t   id = 0x61;
+  static constexpr uint16_t  length = 4;
+  static constexpr uint16_t  maxlength = length;
+  static constexpr Message   message = Message::naveoe;
 };
 
-class navsat
+typedef struct
 {
-  public:
-    navsat( ublox &gps )
-    {
-      buffer = gps.getbuffer();
-      _gps = gps;
-    };
-
-    uint8_t  getnumSvs() { return ((_navsat *)buffer)->intro.numSvs; }
-    uint8_t  getgnssId( int satnum ) { return ((_navsat *)buffer)->block[satnum].gnssId; }
-    uint8_t  getsvId( int satnum ) { return ((_navsat *)buffer)->block[satnum].svId; }
-    uint8_t  getcno( int satnum ) { return ((_navsat *)buffer)->block[satnum].cno; }
-    uint8_t  getelev( int satnum ) { return ((_navsat *)buffer)->block[satnum].elev; }
-    uint8_t  getazim( int satnum ) { return ((_navsat *)buffer)->block[satnum].azim; }
-    uint8_t  getprRes( int satnum ) { return ((_navsat *)buffer)->block[satnum].prRes; }
-    uint8_t  getflags( int satnum ) { return ((_navsat *)buffer)->block[satnum].flags; }
+  _header header;
+  uint32_t  iTOW;
+} _naveoe;
 
-    void pollNavsat()
-    {
-      sendByte( 0xB5 );
-      sendByte( 0x62 );
+// Raw measurements from the M8T, the pseudorange and carrier phase of
+// every signal tracked (RXM-RAWX) and the navigation data words as they
+// were broadcast (RXM-SFRBX)
 
-      byte *pNavsathdr = (byte *)&navsathdr;
+struct _rxmrawxhdr
+{
+  static constexpr uint8_t   cl = 0x02;
+  static constexpr uint8_t   id = 0x15;
+  static constexpr uint16_t  length = 0;  // this is a variable length message
+  static constexpr uint16_t  maxlength = 16 + 32 * 31; // the most that fit in the 1K buffer, stream it for more
+  static constexpr Message   message = Message::rxmrawx;
+  static constexpr uint16_t  introsize = 16;
+  static constexpr uint16_t  blocksize = 32;
+};
 
-      for( unsigned int i = 0; i < sizeof(navsathdr); i++ )
-        buffer[i] = pNavsathdr[i];
+struct _rxmrawxintro
+{
+  double    rcvTow;   // receiver time of week in s
+  uint16_t  week;
+  int8_t    leapS;    // GPS - UTC
+  uint8_t   numMeas;
+  uint8_t   recStat;  // 1 = leap seconds known, 2 = clock reset
+  uint8_t   version;
+  uint8_t   reserved1[2];
+};
 
-      sendPacket( buffer, navsathdr.length + 4 );
+struct _rxmrawxblock
+{
+  double    prMes;    // pseudorange in m
+  double    cpMes;    // carrier phase in cycles
+  float     doMes;    // doppler in Hz
+  uint8_t   gnssId;
+  uint8_t   svId;
+  uint8_t   sigId;    // reserved before version 1
+  uint8_t   freqId;   // GLONASS only
+  uint16_t  locktime; // ms of continuous carrier phase tracking
+  uint8_t   cno;
+  uint8_t   prStdev;  // standard deviations, low 4 bits
+  uint8_t   cpStdev;
+  uint8_t   doStdev;
+  uint8_t   trkStat;  // 1 = pr valid, 2 = cp valid, 4 = half cycle valid, 8 = half cycle subtracted
+  uint8_t   reserved3;
+};
 
-      uint8_t ck[2];
-      _gps.calculatechecksum( ck, buffer, navsathdr.length + 4 );
+// The intro starts with a double, which a compiler would align to 8 behind
+// the 4 byte header, so it is read on its own at sizeof( _header )
+typedef struct
+{
+  _header header;
+  uint8_t intro[16];
+} _rxmrawx;  // this is the received message, numMeas blocks follow the intro
 
-      sendPacket( ck, 2 );
-    }
+struct _rxmsfrbxhdr
+{
+  static constexpr uint8_t   cl = 0x02;
+  static constexpr uint8_t   id = 0x13;
+  static constexpr uint16_t  length = 0;  // this is a variable length message
+  static constexpr uint16_t  maxlength = 8 + 4 * 16;
+  static constexpr Message   message = Message::rxmsfrbx;
+  static constexpr uint16_t  introsize = 8;
+  static constexpr uint16_t  blocksize = 4;
+};
 
-  private:
-    uint8_t *buffer;
-    ublox _gps;
+struct _rxmsfrbxintro
+{
+  uint8_t   gnssId;
+  uint8_t   svId;
+  uint8_t   reserved1;
+  uint8_t   freqId;
+  uint8_t   numWords;
+  uint8_t   chn;
+  uint8_t   version;
+  uint8_t   reserved2;
 };
 
-class cfggnss
+typedef struct
 {
-  public:
-    cfggnss( ublox &gps )
-    {
-      buffer = gps.getbuffer();
-      _gps = gps;
-    };
+  _header header;
+  _rxmsfrbxintro intro;
+} _rxmsfrbx;  // this is the received message, numWords data words follow the intro
+
+// *** Field access
+// The structs above describe where each field is, they are never laid over
+// a buffer. A packet can start at any address (in a ring buffer, after an
+// odd length packet) and the receiver sends little endian, so the
+// accessors read and write each field with memcpy at its offset. That is
+// one load where the core allows unaligned access and byte loads where it
+// doesn't.
+//
+//   UBXGET( buffer, _navpvt8, lon )
+//   UBXBLOCKGET( buffer, _navsat, _navsatblock, i, cno )  // block i after the intro
+
+template<typename T>
+inline T ubxget( const uint8_t *p )
+{
+  T v;
 
-    uint8_t  getnumConfigBlocks() { return ((_cfggnss *)buffer)->intro.numConfigBlocks; }
-    uint8_t  getgnssId( int blocknum ) { return ((_cfggnss *)buffer)->block[blocknum].gnssId; }
-    uint32_t  getFlags( int blocknum ) { return ((_cfggnss *)buffer)->block[blocknum].flags; }
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  uint8_t b[sizeof( T )];
 
-    void pollCfggnss()
-    {
-      sendByte( 0xB5 );
-      sendByte( 0x62 );
+  for( size_t i = 0; i < sizeof( T ); i++ )
+    b[i] = p[sizeof( T ) - 1 - i];
 
-      byte *pCfggnsshdr = (byte *)&cfggnsshdr;
+  memcpy( &v, b, sizeof( T ) );
+#else
+  memcpy( &v, p, sizeof( T ) );
+#endif
 
-      for( unsigned int i = 0; i < sizeof(cfggnsshdr); i++ )
-        buffer[i] = pCfggnsshdr[i];
+  return v;
+}
 
-      sendPacket( buffer, cfggnsshdr.length + 4 );
+template<typename T>
+inline void ubxset( uint8_t *p, T v )
+{
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  uint8_t b[sizeof( T )];
 
-      uint8_t ck[2];
-      _gps.calculatechecksum( ck, buffer, cfggnsshdr.length + 4 );
+  memcpy( b, &v, sizeof( T ) );
 
-      sendPacket( ck, 2 );
-    }
+  for( size_t i = 0; i < sizeof( T ); i++ )
+    p[i] = b[sizeof( T ) - 1 - i];
+#else
+  memcpy( p, &v, sizeof( T ) );
+#endif
+}
 
-    void setCfggnss( int gnssId, bool enable )
-    {
-      if( enable )
-        ((_cfggnss *)buffer)->block[gnssId].flags |= 1;
-      else
-        ((_cfggnss *)buffer)->block[gnssId].flags &= 0xFFFFFFFE;
+#define UBXGET( p, S, f ) ubxget<decltype( S::f )>( ( p ) + offsetof( S, f ) )
+#define UBXSET( p, S, f, v ) ubxset<decltype( S::f )>( ( p ) + offsetof( S, f ), v )
+#define UBXBLOCKGET( p, S, B, i, f ) ubxget<decltype( B::f )>( ( p ) + sizeof( S ) + ( i ) * sizeof( B ) + offsetof( B, f ) )
+#define UBXBLOCKSET( p, S, B, i, f, v ) ubxset<decltype( B::f )>( ( p ) + sizeof( S ) + ( i ) * sizeof( B ) + offsetof( B, f ), v )
 
-      sendByte( 0xB5 );
-      sendByte( 0x62 );
+// The header of the packet at p
+inline _header ubxheader( const uint8_t *p )
+{
+  _header h;
 
-      _cfggnsshdr *pCfggnsshdr = (_cfggnsshdr *)&buffer[0];
+  h.cl = p[0];
+  h.id = p[1];
+  h.length = UBXGET( p, _header, length );
+  return h;
+}
 
-      sendPacket( buffer, pCfggnsshdr->length + 4 );
+// Checks of the layouts against the u-blox 8 protocol spec, the offsets
+// are into the payload as the spec has them. A struct the compiler laid
+// out differently won't build.
+#define UBXAT( S, f, at ) static_assert( offsetof( S, f ) == sizeof( _header ) + ( at ), #S "::" #f " is not where the spec has it" )
+#define UBXSIZE( S, n ) static_assert( sizeof( S ) == ( n ), #S " is not the size the spec has" )
+
+UBXSIZE( _header, 4 );
+static_assert( offsetof( _header, length ) == 2, "_header is not laid out as the spec has it" );
+
+UBXSIZE( _navpvt7, sizeof( _header ) + _navpvt7hdr::length );
+UBXSIZE( _navpvt8, sizeof( _header ) + _navpvt8hdr::length );
+UBXAT( _navpvt8, iTOW, 0 );
+UBXAT( _navpvt8, year, 4 );
+UBXAT( _navpvt8, valid, 11 );
+UBXAT( _navpvt8, tAcc, 12 );
+UBXAT( _navpvt8, nano, 16 );
+UBXAT( _navpvt8, fixType, 20 );
+UBXAT( _navpvt8, numSV, 23 );
+UBXAT( _navpvt8, lon, 24 );
+UBXAT( _navpvt8, height, 32 );
+UBXAT( _navpvt8, hAcc, 40 );
+UBXAT( _navpvt8, velN, 48 );
+UBXAT( _navpvt8, gSpeed, 60 );
+UBXAT( _navpvt8, headMot, 64 );
+UBXAT( _navpvt8, pDOP, 76 );
+UBXAT( _navpvt8, headVeh, 84 );
+UBXAT( _navpvt8, magDec, 88 );
+UBXAT( _navpvt7, pDOP, 76 );
+
+UBXSIZE( _cfgtp5, sizeof( _header ) + _cfgtp5hdr::length );
+UBXAT( _cfgtp5, antCableDelay, 4 );
+UBXAT( _cfgtp5, freqPeriod, 8 );
+UBXAT( _cfgtp5, pulseLenRatio, 16 );
+UBXAT( _cfgtp5, userConfigDelay, 24 );
+UBXAT( _cfgtp5, flags, 28 );
+
+UBXSIZE( _ack, sizeof( _header ) + _ackhdr::length );
+UBXSIZE( _nak, sizeof( _header ) + _nakhdr::length );
+
+UBXSIZE( _navsat, sizeof( _header ) + _navsathdr::introsize );
+UBXSIZE( _navsatblock, _navsathdr::blocksize );
+UBXAT( _navsat, intro.numSvs, 5 );
+static_assert( offsetof( _navsatblock, azim ) == 4 && offsetof( _navsatblock, prRes ) == 6 && offsetof( _navsatblock, flags ) == 8, "_navsatblock is not laid out as the spec has it" );
+
+UBXSIZE( _cfggnss, sizeof( _header ) + _cfggnsshdr::introsize );
+UBXSIZE( _cfggnssblock, _cfggnsshdr::blocksize );
+UBXAT( _cfggnss, intro.numConfigBlocks, 3 );
+static_assert( offsetof( _cfggnssblock, flags ) == 4, "_cfggnssblock is not laid out as the spec has it" );
+
+UBXSIZE( _cfgmsg, sizeof( _header ) + _cfgmsghdr::length );
+UBXAT( _cfgmsg, rate, 2 );
+
+UBXSIZE( _cfgprt, sizeof( _header ) + _cfgprthdr::length );
+UBXAT( _cfgprt, mode, 4 );
+UBXAT( _cfgprt, baudRate, 8 );
+UBXAT( _cfgprt, inProtoMask, 12 );
+UBXAT( _cfgprt, outProtoMask, 14 );
+
+UBXSIZE( _cfgnav5, sizeof( _header ) + _cfgnav5hdr::length );
+UBXAT( _cfgnav5, dynModel, 2 );
+UBXAT( _cfgnav5, fixedAlt, 4 );
+UBXAT( _cfgnav5, minElev, 12 );
+UBXAT( _cfgnav5, staticHoldMaxDist, 28 );
+UBXAT( _cfgnav5, utcStandard, 30 );
+
+UBXSIZE( _cfgrate, sizeof( _header ) + _cfgratehdr::length );
+UBXAT( _cfgrate, timeRef, 4 );
+
+UBXSIZE( _naveoe, sizeof( _header ) + _naveoehdr::length );
+
+UBXSIZE( _rxmrawx, sizeof( _header ) + _rxmrawxhdr::introsize );
+UBXSIZE( _rxmrawxintro, _rxmrawxhdr::introsize );
+UBXSIZE( _rxmrawxblock, _rxmrawxhdr::blocksize );
+static_assert( offsetof( _rxmrawxintro, week ) == 8 && offsetof( _rxmrawxintro, numMeas ) == 11 && offsetof( _rxmrawxintro, recStat ) == 12, "_rxmrawxintro is not laid out as the spec has it" );
+static_assert( offsetof( _rxmrawxblock, doMes ) == 16 && offsetof( _rxmrawxblock, gnssId ) == 20 && offsetof( _rxmrawxblock, locktime ) == 24 &&
+               offsetof( _rxmrawxblock, cno ) == 26 && offsetof( _rxmrawxblock, trkStat ) == 30, "_rxmrawxblock is not laid out as the spec has it" );
+
+UBXSIZE( _rxmsfrbx, sizeof( _header ) + _rxmsfrbxhdr::introsize );
+UBXAT( _rxmsfrbx, intro.numWords, 4 );
+
+#undef UBXAT
+#undef UBXSIZE
+
+// *** Packet registry
+// The header structs above describe every packet we know about. The registry
+// turns a list of them into a small hash table keyed by class and id which
+// is built by the compiler and lives in flash, so finding the packet for an
+// incoming header costs the same however many packets are registered.
+// Packets sharing a class and id (NAV-PVT for the M7 and M8) must be next to
+// each other in the list and are told apart by their length.
+
+#define UBXSLOTS 64         // size of the hash table, must stay a power of 2
+
+#ifndef UBXHASH
+#define UBXHASH 0x0B67      // change this if the compiler reports a collision
+#endif
 
-      uint8_t ck[2];
-      _gps.calculatechecksum( ck, buffer, pCfggnsshdr->length + 4 );
+constexpr uint16_t ubxkey( uint8_t cl, uint8_t id )
+{
+  return ( cl << 8 ) | id;
+}
 
-      sendPacket( ck, 2 );
-    }
+constexpr uint8_t ubxslot( uint16_t key )
+{
+  return (uint16_t)( key * UBXHASH ) >> 10;  // the top 6 bits for 64 slots
+}
 
-  private:
-    uint8_t *buffer;
-    ublox _gps;
+template<typename... M>
+struct _ubxkeys
+{
+  static constexpr uint16_t key[sizeof...( M ) + 1] = { ubxkey( M::cl, M::id )..., 0 };
+  static constexpr uint16_t length[sizeof...( M ) + 1] = { M::length..., 0 };
+  static constexpr uint16_t maxlength[sizeof...( M ) + 1] = { M::maxlength..., 0 };
+  static constexpr Message message[sizeof...( M ) + 1] = { M::message..., Message::none };
 };
 
-// *** ublox configuration stuff
-// This depends on sendPacket() and sendByte() being defined in the main program
+template<typename... M> constexpr uint16_t _ubxkeys<M...>::key[];
+template<typename... M> constexpr uint16_t _ubxkeys<M...>::length[];
+template<typename... M> constexpr uint16_t _ubxkeys<M...>::maxlength[];
+template<typename... M> constexpr Message _ubxkeys<M...>::message[];
 
-// Print the packet specified to the PC  in a hexadecimal form, for debugging
-void printPacket(byte *packet, byte len)
+// index + 1 of the first packet landing in slot s, 0 for an empty slot
+constexpr uint8_t _ubxfirst( const uint16_t *k, uint8_t n, uint8_t s, uint8_t i )
 {
-    char temp[3];
-
-    for (byte i = 0; i < len; i++)
-    {
-        sprintf(temp, "%.2X", packet[i]);
-        Serial.print(temp);
-
-        if (i != len - 1)
-        {
-            Serial.print(' ');
-        }
-    }
-
-    Serial.println();
+  return i == n ? 0 : ubxslot( k[i] ) == s ? i + 1 : _ubxfirst( k, n, s, i + 1 );
 }
 
-// Send a packet to the receiver to restore default configuration
-void restoreDefaults()
-{
-    // CFG-CFG packet
-    byte packet[] = {
-        0xB5, // sync char 1
-        0x62, // sync char 2
-        0x06, // class
-        0x09, // id
-        0x0D, // length
-        0x00, // length
-        0xFF, // payload
-        0xFF, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0xFF, // payload
-        0xFF, // payload
-        0x00, // payload
-        0x00, // payload
-        0x17, // payload
-        0x2F, // CK_A
-        0xAE, // CK_B
-    };
-
-    sendPacket(packet, sizeof(packet));
+constexpr bool _ubxrun( const uint16_t *k, uint8_t from, uint8_t to )
+{
+  return from == to || ( k[from] == k[to] && _ubxrun( k, from + 1, to ) );
 }
 
-// Send a set of packets to the receiver to disable NMEA messages
-void disableNmea()
-{
-    // Array of two bytes for CFG-MSG packets payload
-    byte messages[][2] = {
-        {0xF0, 0x0A},
-        {0xF0, 0x09},
-        {0xF0, 0x00},
-        {0xF0, 0x01},
-        {0xF0, 0x0D},
-        {0xF0, 0x06},
-        {0xF0, 0x02},
-        {0xF0, 0x07},
-        {0xF0, 0x03},
-        {0xF0, 0x04},
-        {0xF0, 0x0E},
-        {0xF0, 0x0F},
-        {0xF0, 0x05},
-        {0xF0, 0x08},
-        {0xF1, 0x00},
-        {0xF1, 0x01},
-        {0xF1, 0x03},
-        {0xF1, 0x04},
-        {0xF1, 0x05},
-        {0xF1, 0x06},
-    };
-
-    // CFG-MSG packet buffer
-    byte packet[] = {
-        0xB5, // sync char 1
-        0x62, // sync char 2
-        0x06, // class
-        0x01, // id
-        0x03, // length
-        0x00, // length
-        0x00, // payload (first byte from messages array element)
-        0x00, // payload (second byte from messages array element)
-        0x00, // payload (not changed in the case)
-        0x00, // CK_A
-        0x00, // CK_B
-    };
-    byte packetSize = sizeof(packet);
-
-    // Offset to the place where payload starts
-    byte payloadOffset = 6;
-
-    // Iterate over the messages array
-    for (byte i = 0; i < sizeof(messages) / sizeof(*messages); i++)
-    {
-        // Copy two bytes of payload to the packet buffer
-        for (byte j = 0; j < sizeof(*messages); j++)
-        {
-            packet[payloadOffset + j] = messages[i][j];
-        }
-
-        // Set checksum bytes to the null
-        packet[packetSize - 2] = 0x00;
-        packet[packetSize - 1] = 0x00;
-
-        // Calculate checksum over the packet buffer excluding sync (first two) and checksum chars (last two)
-        for (byte j = 0; j < packetSize - 4; j++)
-        {
-            packet[packetSize - 2] += packet[2 + j];
-            packet[packetSize - 1] += packet[packetSize - 2];
-        }
-        sendPacket(packet, packetSize);
-    }
+// every packet has to be reachable from the first packet in its slot
+constexpr bool _ubxunique( const uint16_t *k, uint8_t n, uint8_t i )
+{
+  return i == n || ( _ubxrun( k, _ubxfirst( k, n, ubxslot( k[i] ), 0 ) - 1, i ) && _ubxunique( k, n, i + 1 ) );
 }
 
-// Send a packet to the receiver to change baudrate (in bits/second)
-void changeBaudrate( uint32_t baudRate )
-{
-    // CFG-PRT packet
-    byte packet[] = {
-        0xB5, // sync char 1
-        0x62, // sync char 2
-        0x06, // class
-        0x00, // id
-        0x14, // length
-        0x00, // length
-        0x01, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0xD0, // payload
-        0x08, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0xC2, // payload
-        0x01, // payload
-        0x00, // payload
-        0x07, // payload
-        0x00, // payload
-        0x03, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // payload
-        0x00, // CK_A
-        0x00, // CK_B
-    };
-
-    uint8_t *mbr = (uint8_t *)&baudRate;
-    //*mbr = baudRate;
-    for( int i = 0; i < 4; i++ )
-      packet[i + 14] = *(mbr++);
-
-    byte packetSize = sizeof(packet);
-
-    for (byte j = 0; j < packetSize - 4; j++)
-    {
-        packet[packetSize - 2] += packet[2 + j];
-        packet[packetSize - 1] += packet[packetSize - 2];
-    }
-
-    sendPacket(packet, sizeof(packet));
+// index of the packet with exactly this key and length, -1 if there isn't one
+constexpr int _ubxindex( const uint16_t *k, const uint16_t *l, uint8_t n, uint16_t key, uint16_t length, uint8_t i )
+{
+  return i == n ? -1 : k[i] == key && l[i] == length ? i : _ubxindex( k, l, n, key, length, i + 1 );
 }
 
-// Send a packet to the receiver to change nav period to requested ms (1000 = 1 Hz)
-void changeFrequency( uint16_t ms )
+// the longest payload of the first n packets
+constexpr uint16_t _ubxlongest( const uint16_t *l, uint8_t n )
 {
-    // CFG-RATE packet
-    byte packet[] = {
-        0xB5, // sync char 1
-        0x62, // sync char 2
-        0x06, // class
-        0x08, // id
-        0x06, // length
-        0x00, // length
-        0x64, // payload
-        0x00, // payload
-        0x01, // payload
-        0x00, // payload
-        0x01, // payload
-        0x00, // payload
-        0x00, // CK_A
-        0x00, // CK_B
-    };
-
-    uint16_t *msp = (uint16_t *)&packet[6];
-    *msp = ms;
-
-    byte packetSize = sizeof(packet);
-
-    for (byte j = 0; j < packetSize - 4; j++)
-    {
-        packet[packetSize - 2] += packet[2 + j];
-        packet[packetSize - 1] += packet[packetSize - 2];
-    }
-
-    sendPacket(packet, sizeof(packet));
+  return n == 0 ? 0 : l[n - 1] > _ubxlongest( l, n - 1 ) ? l[n - 1] : _ubxlongest( l, n - 1 );
 }
 
-// Send a packet to the receiver to change dynamic model
-void changeDynamicModel( uint8_t model )
+constexpr uint32_t _ubxsum()
 {
-    // CFG-NAV5 packet
-    byte packet[44] = {
-        0xB5, // sync char 1
-        0x62, // sync char 2
-        0x06, // class
-        0x24, // id
-        0x24, // length
-        0x00, // length
-        0x01, // payload - choose dynamic model
-        0x00,
-        0x00 // payload - dynModel
-    };
-
-    uint8_t *dmp = (uint8_t *)&packet[8];
-    *dmp = model;
+  return 0;
+}
 
-    byte packetSize = sizeof(packet);
+template<typename... R>
+constexpr uint32_t _ubxsum( uint32_t v, R... rest )
+{
+  return v + _ubxsum( rest... );
+}
 
-    packet[packetSize - 2] = 0;
-    packet[packetSize - 1] = 0;
+// variable length packets (length 0) have to say how long they can get
+constexpr bool _ubxbounded( const uint16_t *l, const uint16_t *m, uint8_t n )
+{
+  return n == 0 || ( ( l[n - 1] != 0 || m[n - 1] != 0 ) && _ubxbounded( l, m, n - 1 ) );
+}
 
-    for (byte j = 0; j < packetSize - 4; j++)
-    {
-        packet[packetSize - 2] += packet[2 + j];
-        packet[packetSize - 1] += packet[packetSize - 2];
-    }
+template<uint8_t... S> struct _ubxseq {};
+template<uint8_t N, uint8_t... S> struct _ubxmakeseq : _ubxmakeseq<N - 1, N - 1, S...> {};
+template<uint8_t... S> struct _ubxmakeseq<0, S...> { typedef _ubxseq<S...> type; };
 
-    sendPacket(packet, sizeof(packet));
-}
+template<typename S, typename... M> struct _ubxslots;
 
-// Send a packet to the receiver to disable unnecessary channels
-void disableUnnecessaryChannels()
+template<uint8_t... S, typename... M>
+struct _ubxslots<_ubxseq<S...>, M...>
 {
-    // CFG-GNSS packet
-    byte packet[] = {
-        0xB5, // sync char 1
-        0x62, // sync char 2
-        0x06, // class
-        0x3E, // id
-        0x24, // length
-        0x00, // length
+  static constexpr uint8_t slot[sizeof...( S )] = { _ubxfirst( _ubxkeys<M...>::key, sizeof...( M ), S, 0 )... };
+};
 
-        0x00, 0x00, 0x16, 0x04, 0x00, 0x04, 0xFF, 0x00, // payload
-        0x01, 0x00, 0x00, 0x01, 0x01, 0x01, 0x03, 0x00, // payload
-        0x00, 0x00, 0x00, 0x01, 0x05, 0x00, 0x03, 0x00, // payload
-        0x00, 0x00, 0x00, 0x01, 0x06, 0x08, 0xFF, 0x00, // payload
-        0x00, 0x00, 0x00, 0x01,                         // payload
+template<uint8_t... S, typename... M> constexpr uint8_t _ubxslots<_ubxseq<S...>, M...>::slot[];
 
-        0xA4, // CK_A
-        0x25, // CK_B
-    };
+template<typename... M>
+struct ubxregistry
+{
+  typedef _ubxkeys<M...> keys;
+  typedef _ubxslots<typename _ubxmakeseq<UBXSLOTS>::type, M...> slots;
 
-    sendPacket(packet, sizeof(packet));
-}
+  static constexpr uint8_t count = sizeof...( M );
+  static constexpr uint16_t longest = _ubxlongest( keys::maxlength, sizeof...( M ) );
 
-// Send a packet to the receiver to enable NAV-PVT messages
-void enableNavPvt()
-{
-    // CFG-MSG packet
-    byte packet[] = {
-        0xB5, // sync char 1
-        0x62, // sync char 2
-        0x06, // class
-        0x01, // id
-        0x03, // length
-        0x00, // length
-        0x01, // payload
-        0x07, // payload
-        0x01, // payload
-        0x13, // CK_A
-        0x51, // CK_B
-    };
-
-    sendPacket(packet, sizeof(packet));
-}
+  static_assert( _ubxunique( keys::key, sizeof...( M ), 0 ), "registered packets collide in the hash table, change UBXHASH" );
+  static_assert( _ubxbounded( keys::length, keys::maxlength, sizeof...( M ) ), "a variable length packet needs a maxlength" );
 
-// Send a packet to the receiver to enable NAV-SAT messages
-void enableNavSat()
-{
-    // CFG-MSG packet
-    byte packet[] = {
-        0xB5, // sync char 1
-        0x62, // sync char 2
-        0x06, // class
-        0x01, // id
-        0x03, // length
-        0x00, // length
-        0x01, // payload
-        0x35, // payload
-        0x01, // payload
-        0x00, // CK_A
-        0x00, // CK_B
-    };
+  // Returns the index of the packet in the list or -1 if we don't know it.
+  // Can't always check the length because some packets have unknown length (set as 0)
+  static int find( uint8_t cl, uint8_t id, uint16_t length )
+  {
+    uint16_t key = ubxkey( cl, id );
+    uint8_t i = slots::slot[ubxslot( key )];
 
-    byte packetSize = sizeof(packet);
+    if( i == 0 )
+      return -1;
 
-    for (byte j = 0; j < packetSize - 4; j++)
+    for( i--; i < count && keys::key[i] == key; i++ )
     {
-        packet[packetSize - 2] += packet[2 + j];
-        packet[packetSize - 1] += packet[packetSize - 2];
+      if( keys::length[i] == length || keys::length[i] == 0 )
+        return i;
     }
 
-    sendPacket(packet, sizeof(packet));
-}
+    return -1;
+  };
 
-void pollTimePulseParameters()
-{
-  byte packet[] =
+  // True if any registered packet has this class and id
+  static bool known( uint8_t cl, uint8_t id )
   {
-      0xB5, // sync char 1
-      0x62, // sync char 2
-      0x06, // class
-      0x31, // id
-      0x00, // length
-      0x00, // length
-      0x00, // CK_A
-      0x00, // CK_B
-  };
+    uint16_t key = ubxkey( cl, id );
+    uint8_t i = slots::slot[ubxslot( key )];
 
-  byte packetSize = sizeof(packet);
+    return i != 0 && keys::key[i - 1] == key;
+  };
 
-  for (byte j = 0; j < packetSize - 4; j++)
+  template<typename H>
+  static constexpr int indexof()
   {
-      packet[packetSize - 2] += packet[2 + j];
-      packet[packetSize - 1] += packet[packetSize - 2];
-  }
+    return _ubxindex( keys::key, keys::length, count, ubxkey( H::cl, H::id ), H::length, 0 );
+  };
+};
+
+// resync means the packet being received turned out to be bad and the bytes
+// we already have need to be looked at again. skip and skipcheck pass over
+// a packet we don't want without keeping it. stream and streamcheck pass a
+// streamed packet to its handlers a block at a time.
+enum class State { sync1, sync2, header, payload, check1, check2, resync, skip, skipcheck, stream, streamcheck };
+
+// What to do with a UBX packet that isn't in the registry. off hunts for
+// the next sync pair inside it (as it always used to), skip steps over it
+// using its length and verify does the same but checks its checksum too.
+// Skipping saves time on unwanted traffic but it trusts the header: after a
+// false sync the bytes stepped over are gone, along with any real packets
+// in them, even if verify then finds the checksum bad. So off is the
+// default, turn skipping on only for a clean link with a lot of traffic
+// that isn't registered.
+enum class SkipMode { off, skip, verify };
+
+#ifndef UBXSKIPMAX
+#define UBXSKIPMAX 2048     // longest packet we believe enough to skip
+#endif
+
+#ifndef UBXSKIPCOUNTS
+#define UBXSKIPCOUNTS 16    // how many different skipped packets are counted
+#endif
+
+// The UBX classes in the M8 protocol description, anything else is noise
+constexpr bool ubxclass( uint8_t cl )
+{
+  return cl < 0x20 ? ( ( 0x00092E76UL >> cl ) & 1 ) != 0 : cl == 0x21 || cl == 0x27 || cl == 0x28;
+}
+
+// Packets skipped because they weren't registered, by class and id
+struct ubxskipcount
+{
+  uint8_t   cl;
+  uint8_t   id;
+  uint32_t  frames;
+  uint32_t  bytes;   // including sync, header and checksum
+};
+
+#ifndef UBXSTATS
+#define UBXSTATS 1          // 0 compiles the parser counters out
+#endif
+
+// What the parser has seen, to tell UART overruns (checksum errors and
+// resyncs) from line noise (discarded bytes, header rejects) from parser
+// bugs (length mismatches, oversize). bytes and discarded are added per
+// run of input, everything else per packet.
+template<uint8_t N>
+struct ubxcounters
+{
+  uint32_t  bytes;            // everything given to parse()
+  uint32_t  discarded;        // thrown away while hunting for a sync pair
+  uint32_t  frames[N];        // good packets, by registry index
+  uint32_t  headerrejects;    // sync pair followed by a header we don't know
+  uint32_t  lengthmismatches; // known class and id with the wrong length
+  uint32_t  oversize;         // too long for the buffer (or the ring)
+  uint32_t  checksumerrors;
+  uint32_t  resyncs;
+  uint32_t  recovered;        // good packets found by a resync
+  uint32_t  skipped;          // unregistered packets stepped over
+};
+
+template<bool Enabled, uint8_t N>
+struct ubxstats
+{
+  ubxstats()
+  {
+    reset();
+  };
+
+  void add( uint32_t ubxcounters<N>::*field, uint32_t n = 1 )
+  {
+    counters.*field += n;
+  };
+
+  void frame( int i )
+  {
+    counters.frames[i]++;
+  };
+
+  ubxcounters<N> snapshot() const
+  {
+    return counters;
+  };
+
+  void reset()
+  {
+    memset( &counters, 0, sizeof( counters ) );
+  };
+
+  ubxcounters<N> counters;
+};
+
+// Compiled out, every count is a no-op and a snapshot is all zeros
+template<uint8_t N>
+struct ubxstats<false, N>
+{
+  void add( uint32_t ubxcounters<N>::*, uint32_t = 1 ) {};
+  void frame( int ) {};
+  ubxcounters<N> snapshot() const { return ubxcounters<N>(); };
+  void reset() {};
+};
+
+// What the accessor classes need from a parser, the packet being handled
+class _ubxpacket
+{
+  public:
+    // This is the parser's buffer except while a handler is looking at a
+    // packet in a ring buffer.
+    uint8_t *getbuffer()
+    {
+      return packet_p;
+    };
+
+    uint8_t *packet_p;
+};
+
+// A complete packet as handed to callbacks. data points at the class byte
+// (the sync bytes are not included) and length covers the header plus the
+// payload. data is either the parser's buffer or, in zero copy mode, the
+// caller's ring buffer.
+struct ubxframe
+{
+  Message   message;
+  uint8_t  *data;
+  uint16_t  length;
+};
+
+// Called once for every complete packet. The frame is only valid until the
+// next call to parse() so copy out anything that is needed later.
+typedef void (*framecallback)( const ubxframe &frame, void *context );
+
+// Something that wants to see every packet, like the message store below.
+// Any number of them can be attached to a parser and they are called in
+// turn for each good packet.
+class ubxlistener
+{
+  public:
+    virtual void onframe( const ubxframe &frame ) = 0;
+
+    ubxlistener *next = nullptr;
+};
+
+// A typed handler registered with on<>(). The function pointer is stored
+// untyped and cast back by the thunk that was instantiated for its type.
+typedef void (*_ubxfn)();
+
+struct _ubxhandler
+{
+  void (*thunk)( _ubxpacket &gps, _ubxfn fn, void *context );
+  _ubxfn fn;
+  void *context;
+};
+
+// A packet that is streamed rather than kept whole, see ubxparser::stream()
+
+#ifndef UBXSTREAMS
+#define UBXSTREAMS 2        // how many packets a parser can stream
+#endif
+
+struct _ubxstream
+{
+  uint8_t   cl;
+  uint8_t   id;
+  uint16_t  introsize;
+  uint16_t  blocksize;
+  Message   message;
+  void (*block)( const ubxframe &frame, const uint8_t *block, uint16_t index, _ubxfn fn, void *context );
+  void (*end)( const ubxframe &frame, bool good, _ubxfn fn, void *context );
+  _ubxfn onblock;
+  _ubxfn onend;
+  void *context;
+};
+
+/*
+  This is the class for parsing incoming packets. It uses a state-machine
+  approach and can be fed either a single byte at a time or whole chunks as
+  they come out of the serial driver.
+
+  parse( c ) returns the packet on completion or Message::none otherwise.
+  parse( data, len ) returns the number of packets completed in the chunk.
+  parse( ring, size, tail, head ) works straight out of a ring buffer owned
+  by the serial driver without copying the packets.
+  Every packet is reported through the callback set with onframe() and
+  handlers for particular packets can be registered with on<>(), e.g.
+
+    void shownav( navpvt8 &nav ) { ... }
+    gps.on<navpvt8>( shownav );
+
+  The parser is built for a list of accessor classes (see the ublox typedef
+  below for all of them). Its registry, handler table and buffer come from
+  that list, so the buffer is only as long as the longest of those packets.
+  Stats false compiles the counters out.
+
+  A packet made of an intro and repeated blocks (its descriptor gives
+  introsize and blocksize) can be streamed instead, however long it is:
+
+    void onsat( navsat &sats, const uint8_t *block, uint16_t i, void *context ) { ... }
+    void onsats( navsat &sats, bool good, void *context ) { ... }
+    gps.stream<navsat>( onsat, onsats );
+
+  Each block is handed over as it arrives and the second handler says
+  whether the checksum was good, so only the intro and one block are ever
+  in the buffer and the packet doesn't have to be in the list.
+*/
+
+template<bool Stats, typename... M>
+class ubxparser : public _ubxpacket
+{
+  public:
+    typedef ubxregistry<typename M::hdr...> registry;
+    typedef ubxcounters<registry::count> counters;
+
+    static_assert( sizeof( _header ) + registry::longest + 2 <= MAXBUFFERSIZE, "the longest packet doesn't fit in MAXBUFFERSIZE, raise it" );
+
+    ubxparser()
+    {
+        state = State::sync1;
+        count = 0;
+        checksumerrors = 0;
+        packet_p = buffer;
+        skipmode = SkipMode::off;
+        skipcounts = 0;
+        skippedother = 0;
+        callback = nullptr;
+        context = nullptr;
+        memset( handlers, 0, sizeof( handlers ) );
+        listeners = nullptr;
+        streams = 0;
+    };
+
+    void attach( ubxlistener &listener )
+    {
+      listener.next = listeners;
+      listeners = &listener;
+    };
+
+    void onframe( framecallback cb, void *ctx = nullptr )
+    {
+      callback = cb;
+      context = ctx;
+    };
+
+    template<class T>
+    void on( void (*handler)( T &packet ) )
+    {
+      sethandler<T>( &ubxparser::call<T>, (_ubxfn)handler, nullptr );
+    };
+
+    template<class T>
+    void on( void (*handler)( T &packet, void *context ), void *ctx )
+    {
+      sethandler<T>( &ubxparser::callcontext<T>, (_ubxfn)handler, ctx );
+    };
+
+    // Streams a packet instead of keeping it whole. onblock gets each block
+    // as it arrives, with a view of the packet of which only the intro can
+    // be read, e.g. UBXGET( block, _navsatblock, cno ) for the block. onend
+    // is called once the checksum is in, and if good is false everything
+    // onblock was given must be thrown away. With the ring buffer parse()
+    // the packet is checked first (so it must fit in the ring) and onend
+    // always gets true.
+    template<class T>
+    bool stream( void (*onblock)( T &packet, const uint8_t *block, uint16_t index, void *context ),
+                 void (*onend)( T &packet, bool good, void *context ), void *ctx = nullptr )
+    {
+      static_assert( T::hdr::blocksize > 0, "only a packet with repeated blocks can be streamed" );
+      static_assert( sizeof( _header ) + T::hdr::introsize + T::hdr::blocksize <= sizeof( buffer ), "the intro and a block don't fit in the buffer" );
+
+      if( streams == UBXSTREAMS )
+        return false;
+
+      _ubxstream &s = streamed[streams++];
+
+      s.cl = T::hdr::cl;
+      s.id = T::hdr::id;
+      s.introsize = T::hdr::introsize;
+      s.blocksize = T::hdr::blocksize;
+      s.message = T::hdr::message;
+      s.block = &ubxparser::streamblock<T>;
+      s.end = &ubxparser::streamend<T>;
+      s.onblock = (_ubxfn)onblock;
+      s.onend = (_ubxfn)onend;
+      s.context = ctx;
+      return true;
+    };
+
+    // Whether a packet with this header would be streamed
+    bool isstreamed( const _header &h )
+    {
+      return findstream( h ) >= 0;
+    };
+
+    // Byte at a time version, kept for compatibility
+    Message parse( uint8_t c )
+    {
+      if( parse( &c, 1 ) )
+        return result;
+
+      return Message::none;
+    };
+
+    size_t parse( const uint8_t *data, size_t len )
+    {
+      const uint8_t *end = data + len;
+      size_t frames = 0;
+
+      stats.add( &counters::bytes, len );
+
+      while( data < end )
+      {
+        frames += consume( data, end );
+
+        if( state == State::resync )
+          frames += replay( count );
+      }
+
+      return frames;
+    };
+
+    // Zero copy version for a ring buffer filled by the serial driver (or DMA).
+    // head is where the driver will write next and tail is where we read
+    // from; tail is moved past everything that has been dealt with and the
+    // driver must not write over anything from tail onwards. A packet is only
+    // looked at once all of it has arrived, and then handlers and callbacks
+    // see it where it sits in the ring. The one exception is a packet that
+    // wraps around the end of the ring, it is put together in our buffer.
+    // Because nothing is copied out of the ring a bad packet simply means
+    // moving on by one byte, so no resync is needed. Don't mix this with the
+    // other versions of parse() on the same parser.
+    size_t parse( uint8_t *ring, size_t size, size_t &tail, size_t head )
+    {
+      size_t frames = 0;
+      size_t from = tail;
+
+      while( tail != head )
+      {
+        // Jump to the next possible start of a packet in the part of the
+        // ring that doesn't wrap
+        size_t run = head > tail ? head - tail : size - tail;
+        uint8_t *s = (uint8_t *)memchr( &ring[tail], 0xB5, run );
+
+        if( s == nullptr )
+        {
+          stats.add( &counters::discarded, run );
+          tail = ( tail + run ) % size;
+          continue;
+        }
+
+        stats.add( &counters::discarded, s - &ring[tail] );
+        tail = s - ring;
+
+        size_t avail = head >= tail ? head - tail : size - tail + head;
+
+        if( avail < 2 + sizeof( _header ) )
+          break;  // wait for the rest of the header
+
+        if( ring[( tail + 1 ) % size] != 0x62 )
+        {
+          stats.add( &counters::discarded );
+          tail = ( tail + 1 ) % size;
+          continue;
+        }
+
+        uint8_t raw[sizeof( _header )];
+        size_t start = ( tail + 2 ) % size;
+
+        ringcopy( raw, ring, size, start, sizeof( raw ) );
+
+        _header h = ubxheader( raw );
+
+        // the header and payload have to be counted in 16 bits below
+        if( h.length > 0xFFFF - sizeof( _header ) )
+        {
+          countreject( h, registry::find( h.cl, h.id, h.length ) );
+          stats.add( &counters::discarded );
+          tail = ( tail + 1 ) % size;
+          continue;
+        }
+
+        int st = findstream( h );
+
+        if( st >= 0 && 2 + sizeof( _header ) + h.length + 2 < size )
+        {
+          if( avail < 2 + sizeof( _header ) + h.length + 2 )
+            break;  // wait for the rest of the packet
+
+          uint16_t n = sizeof( _header ) + h.length;
+
+          if( !ringchecksum( ring, size, start, n ) )
+          {
+            checksumerrors++;
+            stats.add( &counters::discarded );
+            tail = ( tail + 1 ) % size;
+            continue;
+          }
+
+          ringstream( streamed[st], ring, size, start, h.length );
+          tail = ( start + n + 2 ) % size;
+          continue;
+        }
+
+        int i = registry::find( h.cl, h.id, h.length );
+
+        if( i < 0 && skippable( h.cl, h.id, h.length ) && 2 + sizeof( _header ) + h.length + 2 < size )
+        {
+          if( avail < 2 + sizeof( _header ) + h.length + 2 )
+            break;  // wait for the rest of the packet
+
+          uint16_t n = sizeof( _header ) + h.length;
+
+          if( skipmode == SkipMode::verify && !ringchecksum( ring, size, start, n ) )
+          {
+            checksumerrors++;
+            stats.add( &counters::discarded );
+            tail = ( tail + 1 ) % size;  // nothing is lost, the bytes are still in the ring
+            continue;
+          }
+
+          countskipped( h.cl, h.id, h.length );
+          tail = ( start + n + 2 ) % size;
+          continue;
+        }
+
+        // a packet can never be longer than the ring
+        if( i < 0 || 2 + sizeof( _header ) + h.length + 2 >= size )
+        {
+          countreject( h, i );
+          stats.add( &counters::discarded );
+          tail = ( tail + 1 ) % size;
+          continue;
+        }
+
+        if( avail < 2 + sizeof( _header ) + h.length + 2 )
+          break;  // wait for the rest of the packet
+
+        uint16_t n = sizeof( _header ) + h.length;
+
+        if( !ringchecksum( ring, size, start, n ) )
+        {
+          checksumerrors++;
+          stats.add( &counters::discarded );
+          tail = ( tail + 1 ) % size;
+          continue;
+        }
+
+        packet = i;
+        result = registry::keys::message[i];
+        length = h.length;
+
+        if( start + n <= size )
+        {
+          frames++;
+          deliver( &ring[start] );
+        }
+        else if( n <= sizeof( buffer ) )
+        {
+          ringcopy( buffer, ring, size, start, n );
+          frames++;
+          deliver( buffer );
+        }
+        else
+          stats.add( &counters::oversize );  // wraps and doesn't fit in our buffer either
+
+        tail = ( start + n + 2 ) % size;
+      }
+
+      stats.add( &counters::bytes, ( tail + size - from ) % size );
+
+      return frames;
+    };
+
+    void setskipmode( SkipMode mode )
+    {
+      skipmode = mode;
+    };
+
+    // The packets that were skipped, one entry per class and id seen. Any
+    // that didn't fit in the table are added up in getskippedother().
+    uint8_t getskippedtypes()
+    {
+      return skipcounts;
+    };
+
+    const ubxskipcount &getskipped( uint8_t i )
+    {
+      return skipped[i];
+    };
+
+    uint32_t getskippedother()
+    {
+      return skippedother;
+    };
+
+    uint32_t getchecksumerrors()
+    {
+      return checksumerrors;
+    }
+
+    // How many times we had to look back through a bad packet and how many
+    // good packets were found in the bytes that would have been thrown away
+    uint32_t getresyncs()
+    {
+      return stats.snapshot().resyncs;
+    }
+
+    uint32_t getrecovered()
+    {
+      return stats.snapshot().recovered;
+    }
+
+    // A copy of all the counters, checksum errors are always counted even
+    // with UBXSTATS 0 and everything else is then 0
+    counters getstats()
+    {
+      counters c = stats.snapshot();
+
+      c.checksumerrors = checksumerrors;
+
+      return c;
+    }
+
+    void resetstats()
+    {
+      stats.reset();
+      checksumerrors = 0;
+    }
+
+    uint8_t checksum[2];
+    State state;
+    uint16_t count;
+    uint16_t length;
+    uint8_t *payload_p;
+    int packet;       // index of the packet in the registry
+    Message result = Message::none;
+    uint8_t buffer[sizeof( _header ) + registry::longest + 2];  // room for the checksum too
+    uint32_t checksumerrors; // this is to help look for buffer problems...
+    ubxstats<Stats, registry::count> stats;
+    SkipMode skipmode;
+    ubxskipcount skipped[UBXSKIPCOUNTS];
+    uint8_t skipcounts;
+    uint32_t skippedother;
+    framecallback callback;
+    void *context;
+    _ubxhandler handlers[registry::count];
+    ubxlistener *listeners;
+    _ubxstream streamed[UBXSTREAMS];
+    uint8_t streams;
+    uint16_t blocks;  // blocks of the packet being streamed so far
+
+  private:
+    template<class T>
+    void sethandler( void (*thunk)( _ubxpacket &, _ubxfn, void * ), _ubxfn fn, void *ctx )
+    {
+      constexpr int i = registry::template indexof<typename T::hdr>();
+      static_assert( i >= 0, "this packet is not in the registry" );
+
+      handlers[i].thunk = thunk;
+      handlers[i].fn = fn;
+      handlers[i].context = ctx;
+    };
+
+    template<class T>
+    static void call( _ubxpacket &gps, _ubxfn fn, void * )
+    {
+      T view( gps );
+      ( (void (*)( T & ))fn )( view );
+    };
+
+    template<class T>
+    static void callcontext( _ubxpacket &gps, _ubxfn fn, void *ctx )
+    {
+      T view( gps );
+      ( (void (*)( T &, void * ))fn )( view, ctx );
+    };
+
+    template<class T>
+    static void streamblock( const ubxframe &frame, const uint8_t *block, uint16_t index, _ubxfn fn, void *ctx )
+    {
+      T view( frame );
+      ( (void (*)( T &, const uint8_t *, uint16_t, void * ))fn )( view, block, index, ctx );
+    };
+
+    template<class T>
+    static void streamend( const ubxframe &frame, bool good, _ubxfn fn, void *ctx )
+    {
+      T view( frame );
+      ( (void (*)( T &, bool, void * ))fn )( view, good, ctx );
+    };
+
+    // Run the state machine over the input until it is used up or a packet
+    // goes bad (state is then State::resync). Returns the packets completed.
+    size_t consume( const uint8_t *&data, const uint8_t *end )
+    {
+      size_t frames = 0;
+
+      while( data < end )
+      {
+        switch( state )
+        {
+          case State::sync1:
+          {
+            // Jump straight to the next possible start of a packet
+            const uint8_t *s = (const uint8_t *)memchr( data, 0xB5, end - data );
+
+            if( s == nullptr )
+            {
+              stats.add( &counters::discarded, end - data );
+              data = end;
+              return frames;
+            }
+
+            stats.add( &counters::discarded, s - data );
+            data = s + 1;
+            state = State::sync2;
+          }
+          break;
+
+          case State::sync2:
+          {
+            uint8_t c = *data++;
+
+            if( c == 0x62 )
+            {
+              count = 0;
+              checksum[0] = 0;
+              checksum[1] = 0;
+              state = State::header;
+            }
+            else if( c != 0xB5 ) // a repeated 0xB5 could still be the real sync
+            {
+              stats.add( &counters::discarded, 2 );
+              state = State::sync1;
+            }
+            else
+              stats.add( &counters::discarded );
+          }
+          break;
+
+          case State::header:
+          {
+            // note: we are not putting the sync bytes in the buffer
+            data += fill( data, end, sizeof( _header ) );
+
+            if( count == sizeof( _header ) )
+              lookup();
+          }
+          break;
+
+          case State::payload:
+          {
+            data += fill( data, end, length + sizeof( _header ) );
+
+            if( count == length + sizeof( _header ) )
+              endpayload();
+          }
+          break;
+
+          // The checksum bytes are kept after the payload (there is room
+          // for them) so they can be looked at again if the packet is bad
+          case State::check1:
+          {
+            uint8_t c = *data++;
+
+            buffer[count++] = c;
+
+            if( c == checksum[0] ) // check the first checksum byte
+              state = State::check2;
+            else
+            {
+              checksumerrors++;
+              state = State::resync;
+            }
+          }
+          break;
+
+          case State::check2:
+          {
+            uint8_t c = *data++;
+
+            buffer[count++] = c;
+
+            if( c == checksum[1] )
+            {
+              state = State::sync1; // set to look at next packet
+              frames++;
+              deliver( buffer );
+            }
+            else
+            {
+              checksumerrors++;
+              state = State::resync;
+            }
+          }
+          break;
+
+          // Step over a packet we don't want, only looking at the bytes if
+          // the checksum is being checked
+          case State::skip:
+          {
+            size_t n = length - count;
+
+            if( n > (size_t)( end - data ) )
+              n = end - data;
+
+            if( skipmode == SkipMode::verify )
+              accumulate( checksum, data, n );
+
+            data += n;
+            count += n;
+
+            if( count == length )
+            {
+              count = 0;
+              state = State::skipcheck;
+            }
+          }
+          break;
+
+          case State::skipcheck:
+          {
+            uint8_t c = *data++;
+
+            if( skipmode == SkipMode::verify && c != checksum[count] )
+            {
+              checksumerrors++;  // the bytes are gone so all we can do is start hunting again
+              state = State::sync1;
+            }
+            else if( ++count == 2 )
+            {
+              state = State::sync1;
+            }
+          }
+          break;
+
+          // Only the header, the intro and the block coming in are kept,
+          // each block goes where the last one was
+          case State::stream:
+          {
+            _ubxstream &s = streamed[packet];
+            uint16_t intro = sizeof( _header ) + s.introsize;
+
+            data += fill( data, end, count < intro ? intro : intro + s.blocksize );
+
+            if( count == intro + s.blocksize )
+            {
+              s.block( streamframe( s ), &buffer[intro], blocks++, s.onblock, s.context );
+              count = intro;
+            }
+
+            if( count == intro && s.introsize + blocks * s.blocksize == length )
+            {
+              count = 0;
+              state = State::streamcheck;
+            }
+          }
+          break;
+
+          // Like skipcheck, the packet is gone so a bad one can't be looked
+          // at again
+          case State::streamcheck:
+          {
+            uint8_t c = *data++;
+            bool good = c == checksum[count];
+
+            if( !good || ++count == 2 )
+            {
+              _ubxstream &s = streamed[packet];
+
+              if( !good )
+                checksumerrors++;
+
+              state = State::sync1;
+              s.end( streamframe( s ), good, s.onend, s.context );
+            }
+          }
+          break;
+
+          case State::resync:
+            return frames;
+        }
+      }
+
+      return frames;
+    };
+
+    // The first n bytes in the buffer followed a sync pair that didn't lead
+    // to a good packet. Rather than throw them away look for the next sync
+    // pair among them and run what follows it through the state machine
+    // again, in place, before any more input is read. If the real packet
+    // started inside the bad one it is recovered instead of lost.
+    size_t replay( uint16_t n )
+    {
+      size_t frames = 0;
+
+      stats.add( &counters::resyncs );
+
+      for( ;; )
+      {
+        const uint8_t *end = buffer + n;
+        const uint8_t *s = buffer;
+
+        while( ( s = (const uint8_t *)memchr( s, 0xB5, end - s ) ) != nullptr && s + 1 < end && s[1] != 0x62 )
+          s++;
+
+        // the sync pair of the bad packet goes too
+        stats.add( &counters::discarded, 2 + ( ( s ? s : end ) - buffer ) );
+
+        if( s == nullptr )
+        {
+          state = State::sync1;
+          return frames;
+        }
+
+        if( s + 1 == end )  // the sync pair may be completed by the next input
+        {
+          state = State::sync2;
+          return frames;
+        }
+
+        n = end - ( s + 2 );
+        memmove( buffer, s + 2, n );
+
+        count = 0;
+        checksum[0] = 0;
+        checksum[1] = 0;
+        state = State::header;
+
+        // The state machine writes the buffer at or behind where it reads
+        // so it can run over the buffer itself
+        const uint8_t *data = buffer;
+        size_t found = consume( data, buffer + n );
+
+        frames += found;
+        stats.add( &counters::recovered, found );
+
+        if( state != State::resync )
+          return frames;
+
+        // Bad again, so the next attempt covers what was kept for this
+        // packet plus whatever hadn't been read yet
+        memmove( &buffer[count], data, buffer + n - data );
+        n = count + ( buffer + n - data );
+      }
+    };
+
+    void deliver( uint8_t *p )
+    {
+      packet_p = p;
+      stats.frame( packet );
+
+      ubxframe frame = { result, p, (uint16_t)( length + sizeof( _header ) ) };
+
+      for( ubxlistener *l = listeners; l != nullptr; l = l->next )
+        l->onframe( frame );
+
+      if( callback )
+        callback( frame, context );
+
+      _ubxhandler &h = handlers[packet];
+
+      if( h.thunk )
+        h.thunk( *this, h.fn, h.context );
+
+      packet_p = buffer;
+    };
+
+    static void accumulate( uint8_t *ck, const uint8_t *p, size_t n )
+    {
+      for( size_t i = 0; i < n; i++ )
+      {
+        ck[0] += p[i];
+        ck[1] += ck[0];
+      }
+    };
+
+    // Check the checksum of the n bytes at start, which may wrap
+    static bool ringchecksum( const uint8_t *ring, size_t size, size_t start, uint16_t n )
+    {
+      uint8_t ck[2] = { 0, 0 };
+
+      if( start + n <= size )
+        accumulate( ck, &ring[start], n );
+      else
+      {
+        accumulate( ck, &ring[start], size - start );
+        accumulate( ck, ring, n - ( size - start ) );
+      }
+
+      return ck[0] == ring[( start + n ) % size] && ck[1] == ring[( start + n + 1 ) % size];
+    };
+
+    static void ringcopy( uint8_t *dst, const uint8_t *ring, size_t size, size_t pos, size_t n )
+    {
+      size_t first = size - pos < n ? size - pos : n;
+
+      memcpy( dst, &ring[pos], first );
+      memcpy( dst + first, ring, n - first );
+    };
+
+    // Copy as much of the input as we can (up to "upto" bytes in the buffer)
+    // in one go instead of once per state transition. The checksum is over
+    // the header plus the payload so it is accumulated here as the bytes go
+    // by, which leaves nothing to do at the end of the packet.
+    size_t fill( const uint8_t *data, const uint8_t *end, uint16_t upto )
+    {
+      size_t n = upto - count;
+
+      if( n > (size_t)( end - data ) )
+        n = end - data;
+
+      uint8_t *p = &buffer[count];
+      uint8_t ck_a = checksum[0];
+      uint8_t ck_b = checksum[1];
+
+      for( size_t i = 0; i < n; i++ )
+      {
+        uint8_t c = data[i];
+
+        p[i] = c;
+        ck_a += c;
+        ck_b += ck_a;
+      }
+
+      checksum[0] = ck_a;
+      checksum[1] = ck_b;
+      count += n;
+
+      return n;
+    };
+
+    void lookup()
+    {
+      _header h = ubxheader( buffer );
+      int st = findstream( h );
+
+      if( st >= 0 )
+      {
+        packet = st;
+        length = h.length;
+        blocks = 0;
+        state = State::stream;
+        return;
+      }
+
+      int i = registry::find( h.cl, h.id, h.length );
+
+      if( i < 0 && skippable( h.cl, h.id, h.length ) )
+      {
+        countskipped( h.cl, h.id, h.length );
+        length = h.length;
+        count = 0;
+        state = length ? State::skip : State::skipcheck;
+        return;
+      }
+
+      // variable length packets still have to fit in the buffer, with room
+      // for the checksum behind them
+      if( i < 0 || h.length > sizeof( buffer ) - sizeof( _header ) - 2 )
+      {
+        countreject( h, i );
+        state = State::resync;
+        return;
+      }
+
+      packet = i;
+      result = registry::keys::message[i]; // this will be the packet if there are no errors
+      length = h.length;
+      payload_p = &buffer[sizeof( _header )];
+      state = State::payload;
+
+      if( length == 0 )
+        endpayload();
+    };
+
+    // The stream for this header, or -1. The length has to be made of whole
+    // blocks, and no more than 255 of them as the count is one byte in every
+    // UBX packet like this, anything else is not the packet.
+    int findstream( const _header &h )
+    {
+      for( uint8_t i = 0; i < streams; i++ )
+      {
+        const _ubxstream &s = streamed[i];
+
+        if( s.cl == h.cl && s.id == h.id && h.length >= s.introsize && h.length <= s.introsize + 255 * s.blocksize && ( h.length - s.introsize ) % s.blocksize == 0 )
+          return i;
+      }
+
+      return -1;
+    };
+
+    // What the stream handlers see, the header and intro in the buffer
+    ubxframe streamframe( const _ubxstream &s )
+    {
+      ubxframe frame = { s.message, buffer, (uint16_t)( sizeof( _header ) + length ) };
+
+      return frame;
+    };
+
+    // A streamed packet that is all in the ring and has been checked, its
+    // blocks are handed over one by one in the buffer like any other
+    void ringstream( _ubxstream &s, const uint8_t *ring, size_t size, size_t start, uint16_t len )
+    {
+      uint16_t intro = sizeof( _header ) + s.introsize;
+
+      length = len;
+      ringcopy( buffer, ring, size, start, intro );
+
+      for( uint16_t i = 0; s.introsize + i * s.blocksize < len; i++ )
+      {
+        ringcopy( &buffer[intro], ring, size, ( start + intro + i * s.blocksize ) % size, s.blocksize );
+        s.block( streamframe( s ), &buffer[intro], i, s.onblock, s.context );
+      }
+
+      s.end( streamframe( s ), true, s.onend, s.context );
+    };
+
+    // An unregistered packet is only skipped if its header looks real
+    bool skippable( uint8_t cl, uint8_t id, uint16_t len )
+    {
+      return skipmode != SkipMode::off && ubxclass( cl ) && len <= UBXSKIPMAX && !registry::known( cl, id );
+    };
+
+    // Work out why a header was turned down
+    void countreject( const _header &h, int i )
+    {
+      if( i >= 0 )
+        stats.add( &counters::oversize );
+      else if( registry::known( h.cl, h.id ) )
+        stats.add( &counters::lengthmismatches );
+      else
+        stats.add( &counters::headerrejects );
+    };
+
+    void countskipped( uint8_t cl, uint8_t id, uint16_t len )
+    {
+      stats.add( &counters::skipped );
+
+      for( uint8_t i = 0; i < skipcounts; i++ )
+      {
+        if( skipped[i].cl == cl && skipped[i].id == id )
+        {
+          skipped[i].frames++;
+          skipped[i].bytes += len + 8;
+          return;
+        }
+      }
+
+      if( skipcounts < UBXSKIPCOUNTS )
+      {
+        ubxskipcount &s = skipped[skipcounts++];
+
+        s.cl = cl;
+        s.id = id;
+        s.frames = 1;
+        s.bytes = len + 8;
+      }
+      else
+        skippedother++;
+    };
+
+    void endpayload()
+    {
+      // the checksum is already complete, see fill()
+      state = State::check1;
+    };
+};
+
+// *** Sending packets
+// The checksum and sending don't need a parser, so they are plain
+// functions and the accessor classes below are just a pointer each.
+
+// Fletcher checksum over the class, id, length and payload
+inline void ubxchecksum( uint8_t *ck, const uint8_t *packet, uint16_t length )
+{
+  ck[0] = 0;
+  ck[1] = 0;
+
+  for( uint16_t i = 0; i < length; i++ )
+  {
+    ck[0] += packet[i];
+    ck[1] += ck[0];
+  }
+}
+
+#ifndef UBXTXBUFFER
+#define UBXTXBUFFER 128     // ubxsend() puts frames together here
+#endif
+
+// Puts frames together in a buffer so they go to the receiver in one
+// sendPacket() call. Frames are added until the buffer is full, then it is
+// sent and started again, and flush() sends what is left. A frame too long
+// for the buffer is sent on its own.
+class ubxwriter
+{
+  public:
+    ubxwriter( uint8_t *buffer, uint16_t size ) : data( buffer ), size( size ), count( 0 )
+    {
+    };
+
+    // A frame that is complete, sync to checksum, like a ubxcommand
+    void addframe( const uint8_t *frame, uint16_t length )
+    {
+      if( count + length > size )
+        flush();
+
+      if( length > size )
+      {
+        sendPacket( frame, length );
+        return;
+      }
+
+      memcpy( &data[count], frame, length );
+      count += length;
+    };
+
+    template<class C>
+    void add()
+    {
+      addframe( C::data, sizeof( C::data ) );
+    };
+
+    // A packet that starts with its class, the sync bytes and the
+    // checksum are added here
+    void addpacket( const uint8_t *packet, uint16_t length )
+    {
+      uint16_t n = 2 + length + 2;
+
+      if( count + n > size )
+        flush();
+
+      if( n > size )  // can't be put together, so it takes three writes
+      {
+        uint8_t sync[2] = { 0xB5, 0x62 };
+        uint8_t ck[2];
+
+        ubxchecksum( ck, packet, length );
+        sendPacket( sync, 2 );
+        sendPacket( packet, length );
+        sendPacket( ck, 2 );
+        return;
+      }
+
+      uint8_t *p = &data[count];
+
+      p[0] = 0xB5;
+      p[1] = 0x62;
+      memcpy( &p[2], packet, length );
+      ubxchecksum( &p[2 + length], &p[2], length );
+      count += n;
+    };
+
+    void flush()
+    {
+      if( count )
+        sendPacket( data, count );
+
+      count = 0;
+    };
+
+  private:
+    uint8_t *data;
+    uint16_t size;
+    uint16_t count;
+};
+
+// Send a packet that starts with its class, the sync bytes and the
+// checksum are added here
+inline void ubxsend( const uint8_t *packet, uint16_t length )
+{
+  static uint8_t buffer[UBXTXBUFFER];
+  ubxwriter tx( buffer, sizeof( buffer ) );
+
+  tx.addpacket( packet, length );
+  tx.flush();
+}
+
+// A poll is the packet with no payload
+inline void ubxpoll( uint8_t cl, uint8_t id )
+{
+  uint8_t packet[sizeof( _header )] = { cl, id, 0, 0 };
+
+  ubxsend( packet, sizeof( packet ) );
+}
+
+// *** Frame builder
+// A command whose bytes are all known when compiling is built by the
+// compiler, checksum and all, and sits in flash:
+//
+//   typedef ubxcommand<0x06, 0x01, 0x01, 0x07, 0x01> navpvton;  // CFG-MSG
+//   navpvton::send();
+//
+// A command with a few fields that are only known at runtime starts from a
+// constant one and patches them in, see ubxpatch below.
+
+// The two checksum bytes over a list of bytes. CK_B adds each byte once
+// for every byte from it to the end.
+constexpr uint32_t _ubxcka()
+{
+  return 0;
+}
+
+template<typename... B>
+constexpr uint32_t _ubxcka( uint8_t b, B... rest )
+{
+  return b + _ubxcka( rest... );
+}
+
+constexpr uint32_t _ubxckb()
+{
+  return 0;
+}
+
+template<typename... B>
+constexpr uint32_t _ubxckb( uint8_t b, B... rest )
+{
+  return b * ( sizeof...( rest ) + 1 ) + _ubxckb( rest... );
+}
+
+template<uint8_t... B>
+struct ubxbytes
+{
+  static constexpr uint8_t data[sizeof...( B )] = { B... };
+
+  static void send()
+  {
+    sendPacket( data, sizeof( data ) );
+  };
+};
+
+template<uint8_t... B> constexpr uint8_t ubxbytes<B...>::data[];
+
+template<uint8_t... A, uint8_t... B>
+ubxbytes<A..., B...> _ubxjoin( const ubxbytes<A...> *, const ubxbytes<B...> * );
+
+template<class... C> struct _ubxconcat;
+
+template<>
+struct _ubxconcat<>
+{
+  typedef ubxbytes<> type;
+};
+
+template<class C, class... R>
+struct _ubxconcat<C, R...>
+{
+  typedef decltype( _ubxjoin( (C *)nullptr, (typename _ubxconcat<R...>::type *)nullptr ) ) type;
+};
+
+// Sync, class, id, length, payload and checksum. P is the payload.
+template<uint8_t Cl, uint8_t Id, uint8_t... P>
+struct ubxcommand : ubxbytes<0xB5, 0x62, Cl, Id, sizeof...( P ) & 0xFF, ( sizeof...( P ) >> 8 ), P...,
+                             (uint8_t)_ubxcka( Cl, Id, sizeof...( P ) & 0xFF, ( sizeof...( P ) >> 8 ), P... ),
+                             (uint8_t)_ubxckb( Cl, Id, sizeof...( P ) & 0xFF, ( sizeof...( P ) >> 8 ), P... )>
+{
+  static constexpr uint16_t length = sizeof...( P );
+};
+
+// Several constant commands one after the other, in flash and sent in one
+// write: ubxbatch<navpvton, navsaton>::send()
+template<class... C>
+struct ubxbatch : _ubxconcat<C...>::type
+{
+};
+
+// A copy of a constant command with some fields changed. Only the bytes
+// that change go through the checksum, a byte at payload offset i counts
+// once in CK_A and length - i times in CK_B.
+template<class C>
+class ubxpatch
+{
+  public:
+    ubxpatch()
+    {
+      memcpy( frame, C::data, sizeof( frame ) );
+    };
+
+    // offset is into the payload, fields are little endian like all of UBX
+    template<typename T>
+    void set( uint16_t offset, T value )
+    {
+      for( uint8_t i = 0; i < sizeof( T ); i++ )
+        setbyte( offset + i, (uint8_t)( value >> ( 8 * i ) ) );
+    };
+
+    void send()
+    {
+      sendPacket( frame, sizeof( frame ) );
+    };
+
+    uint8_t frame[sizeof( C::data )];
+
+  private:
+    void setbyte( uint16_t offset, uint8_t b )
+    {
+      uint8_t d = b - frame[2 + sizeof( _header ) + offset];
+
+      frame[2 + sizeof( _header ) + offset] = b;
+      frame[sizeof( frame ) - 2] += d;
+      frame[sizeof( frame ) - 1] += d * ( C::length - offset );
+    };
+};
+
+// *** Time
+// The date and time in NAV-PVT as one integer, so none of the nanoseconds are
+// lost to a double (or to double math on a part without an FPU).
+
+#ifndef UBXLEAPSECONDS
+#define UBXLEAPSECONDS 18  // GPS - UTC, NAV-PVT doesn't carry it so change it when IERS does
+#endif
+
+const int64_t ubxnsps = 1000000000;      // nanoseconds per second
+const int64_t ubxgpsepoch = 315964800;   // 1980-01-06 in Unix seconds
+
+// Days from 1970-01-01 to a date in the proleptic Gregorian calendar. The year
+// is taken to start in March so the leap day falls at its end and the month
+// needs no table (Howard Hinnant's days_from_civil).
+inline int32_t ubxdays( int32_t year, uint32_t month, uint32_t day )
+{
+  year -= month <= 2;
+  int32_t era = ( year >= 0 ? year : year - 399 ) / 400;
+  uint32_t yoe = (uint32_t)( year - era * 400 );                                    // [0, 399]
+  uint32_t doy = ( 153 * ( month > 2 ? month - 3 : month + 9 ) + 2 ) / 5 + day - 1;  // [0, 365]
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;                             // [0, 146096]
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+// nano may be negative or past a second, as NAV-PVT allows, it just carries
+inline int64_t ubxunixnano( uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t min, uint8_t sec, int32_t nano )
+{
+  int32_t s = (int32_t)hour * 3600 + (int32_t)min * 60 + sec;
+
+  return ( (int64_t)ubxdays( year, month, day ) * 86400 + s ) * ubxnsps + nano;
+}
+
+// *** Position
+// Positions as NAV-PVT gives them, 1e-7 degrees and millimetres, so a part
+// without an FPU can check a geofence or a position hold every epoch with no
+// floating point. The earth is taken as a sphere of mean radius and as flat
+// between the two points, which is good to well under a percent over tens of
+// kilometres. Results are in millimetres. Past that the flat earth is no use
+// anyway, so ubxnorth() and ubxeast() clamp at +-INT32_MAX (2147 km),
+// ubxdistance2() and ubxdistance() saturate at their largest value past about
+// 3000 km and ubxwithin() is then false for any radius.
+
+const int32_t ubxdeg7 = 10000000;     // 1e-7 degrees in a degree
+const int64_t ubxmm7 = 11119508;      // millimetres in 1e-7 degrees of arc, times 1e6
+
+// cos( lat ) in Q15 from a one degree table, straight lines in between
+inline uint16_t ubxcos15( int32_t lat )
+{
+  static const uint16_t table[91] =
+  {
+    32768, 32763, 32748, 32723, 32688, 32643, 32588, 32524, 32449, 32365,
+    32270, 32166, 32052, 31928, 31795, 31651, 31499, 31336, 31164, 30983,
+    30792, 30592, 30382, 30163, 29935, 29698, 29452, 29197, 28932, 28660,
+    28378, 28088, 27789, 27482, 27166, 26842, 26510, 26170, 25822, 25466,
+    25102, 24730, 24351, 23965, 23571, 23170, 22763, 22348, 21926, 21498,
+    21063, 20622, 20174, 19720, 19261, 18795, 18324, 17847, 17364, 16877,
+    16384, 15886, 15384, 14876, 14365, 13848, 13328, 12803, 12275, 11743,
+    11207, 10668, 10126,  9580,  9032,  8481,  7927,  7371,  6813,  6252,
+     5690,  5126,  4560,  3993,  3425,  2856,  2286,  1715,  1144,   572,
+        0
+  };
+  uint32_t a = lat < 0 ? 0u - (uint32_t)lat : (uint32_t)lat;
+  uint32_t i = a / ubxdeg7;
+
+  if( i >= 90 )
+    return 0;
+
+  uint32_t f = a % ubxdeg7 / 1000;  // [0, 9999]
+  return table[i] - ( table[i] - table[i + 1] ) * f / 10000;
+}
+
+inline int64_t _ubxnorth( int32_t lat1, int32_t lat2 )
+{
+  return ( (int64_t)lat2 - lat1 ) * ubxmm7 / 1000000;
+}
+
+inline int64_t _ubxeast( int32_t lat, int32_t lon1, int32_t lon2 )
+{
+  int64_t d = (int64_t)lon2 - lon1;
+
+  if( d > 180 * (int64_t)ubxdeg7 )
+    d -= 360 * (int64_t)ubxdeg7;
+  else if( d < -180 * (int64_t)ubxdeg7 )
+    d += 360 * (int64_t)ubxdeg7;
+
+  return d * ubxmm7 / 1000000 * ubxcos15( lat ) / 32768;
+}
+
+inline int32_t _ubxclamp( int64_t mm )
+{
+  return mm > INT32_MAX ? INT32_MAX : mm < -INT32_MAX ? -INT32_MAX : (int32_t)mm;
+}
+
+// Millimetres north from lat1 to lat2
+inline int32_t ubxnorth( int32_t lat1, int32_t lat2 )
+{
+  return _ubxclamp( _ubxnorth( lat1, lat2 ) );
+}
+
+// Millimetres east from lon1 to lon2 at lat, the short way round
+inline int32_t ubxeast( int32_t lat, int32_t lon1, int32_t lon2 )
+{
+  return _ubxclamp( _ubxeast( lat, lon1, lon2 ) );
+}
+
+// Square of the distance in mm, left squared so a radius check needs no root
+inline uint64_t ubxdistance2( int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2 )
+{
+  int64_t n = _ubxnorth( lat1, lat2 );
+  int64_t e = _ubxeast( lat1 / 2 + lat2 / 2, lon1, lon2 );
+  const int64_t far = 3000000000;  // both squares still add up inside 64 bits
+
+  if( n > far || n < -far || e > far || e < -far )
+    return UINT64_MAX;
+
+  return (uint64_t)( n * n ) + (uint64_t)( e * e );
+}
+
+inline uint32_t ubxisqrt( uint64_t x )
+{
+  uint64_t r = 0;
+  uint64_t b = (uint64_t)1 << 62;
+
+  while( b > x )
+    b >>= 2;
+
+  while( b )
+  {
+    if( x >= r + b )
+    {
+      x -= r + b;
+      r = ( r >> 1 ) + b;
+    }
+    else
+      r >>= 1;
+    b >>= 2;
+  }
+
+  return (uint32_t)r;
+}
+
+inline uint32_t ubxdistance( int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2 )
+{
+  return ubxisqrt( ubxdistance2( lat1, lon1, lat2, lon2 ) );
+}
+
+// true when the second point is within radius mm of the first
+inline bool ubxwithin( int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2, uint32_t radius )
+{
+  return ubxdistance2( lat1, lon1, lat2, lon2 ) <= (uint64_t)radius * radius;
+}
+
+class navpvt7
+{
+  public:
+    typedef _navpvt7hdr hdr;
+
+    navpvt7( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    navpvt7( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    int32_t getnano() { return UBXGET( buffer, _navpvt7, nano ); }
+    uint8_t getnumSV() { return UBXGET( buffer, _navpvt7, numSV ); }
+    double getlon() { return UBXGET( buffer, _navpvt7, lon ) * en7; }
+    double getlat() { return UBXGET( buffer, _navpvt7, lat ) * en7; }
+    double getheight() { return UBXGET( buffer, _navpvt7, height ) * mm2m; }
+    double gethAcc() { return UBXGET( buffer, _navpvt7, hAcc ) * mm2m; }
+    double getvAcc() { return UBXGET( buffer, _navpvt7, vAcc ) * mm2m; }
+    double getpDOP() { return UBXGET( buffer, _navpvt7, pDOP ) * 0.01; }
+
+    // The same without floating point, in 1e-7 degrees, mm and 0.01 DOP
+    int32_t getlon7() { return UBXGET( buffer, _navpvt7, lon ); }
+    int32_t getlat7() { return UBXGET( buffer, _navpvt7, lat ); }
+    int32_t getheightmm() { return UBXGET( buffer, _navpvt7, height ); }
+    uint32_t gethAccmm() { return UBXGET( buffer, _navpvt7, hAcc ); }
+    uint32_t getvAccmm() { return UBXGET( buffer, _navpvt7, vAcc ); }
+    uint16_t getpDOP100() { return UBXGET( buffer, _navpvt7, pDOP ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+class navpvt8
+{
+  public:
+    typedef _navpvt8hdr hdr;
+
+    navpvt8( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    navpvt8( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint32_t gettacc() { return UBXGET( buffer, _navpvt8, tAcc ); }
+    uint8_t getnumSV() { return UBXGET( buffer, _navpvt8, numSV ); }
+    double getlon() { return UBXGET( buffer, _navpvt8, lon ) * en7; }
+    double getlat() { return UBXGET( buffer, _navpvt8, lat ) * en7; }
+    double getheight() { return UBXGET( buffer, _navpvt8, height ) * mm2m; }
+    double gethAcc() { return UBXGET( buffer, _navpvt8, hAcc ) * mm2m; }
+    int32_t getvAcc() { return UBXGET( buffer, _navpvt8, vAcc ); }
+    double getpDOP() { return UBXGET( buffer, _navpvt8, pDOP ) * 0.01; }
+    uint8_t getflags() { return UBXGET( buffer, _navpvt8, flags ); }
+    uint16_t getyear() { return UBXGET( buffer, _navpvt8, year ); }
+    uint8_t getmonth() { return UBXGET( buffer, _navpvt8, month ); }
+    uint8_t getday() { return UBXGET( buffer, _navpvt8, day ); }
+    uint8_t gethour() { return UBXGET( buffer, _navpvt8, hour ); }
+    uint8_t getminute() { return UBXGET( buffer, _navpvt8, min ); }
+    uint8_t getsecond() { return UBXGET( buffer, _navpvt8, sec ); }
+    int32_t getnano() { return UBXGET( buffer, _navpvt8, nano ); }
+    double getgSpeed() { return UBXGET( buffer, _navpvt8, gSpeed ) * 1.0; }
+    double getheadMot() { return UBXGET( buffer, _navpvt8, headMot ) * en5; } // this one too
+
+    // The same without floating point, in 1e-7 degrees, mm, mm/s, 1e-5 degrees and 0.01 DOP
+    int32_t getlon7() { return UBXGET( buffer, _navpvt8, lon ); }
+    int32_t getlat7() { return UBXGET( buffer, _navpvt8, lat ); }
+    int32_t getheightmm() { return UBXGET( buffer, _navpvt8, height ); }
+    uint32_t gethAccmm() { return UBXGET( buffer, _navpvt8, hAcc ); }
+    uint32_t getvAccmm() { return UBXGET( buffer, _navpvt8, vAcc ); }
+    uint16_t getpDOP100() { return UBXGET( buffer, _navpvt8, pDOP ); }
+    int32_t getgSpeedmm() { return UBXGET( buffer, _navpvt8, gSpeed ); }
+    int32_t getheadMot5() { return UBXGET( buffer, _navpvt8, headMot ); }
+
+    uint8_t getvalid() { return UBXGET( buffer, _navpvt8, valid ); }
+
+    // Nanoseconds since 1970-01-01 UTC. false until the receiver says both
+    // the date and the time are valid (bit 2 of getvalid() says whether UTC
+    // is also fully resolved, i.e. the leap seconds are known)
+    bool getunixnano( int64_t &ns )
+    {
+      if( ( getvalid() & 0x03 ) != 0x03 )
+        return false;
+
+      ns = ubxunixnano( getyear(), getmonth(), getday(), gethour(), getminute(), getsecond(), getnano() );
+      return true;
+    }
+
+    // Nanoseconds since 1980-01-06 GPS time
+    bool getgpsnano( int64_t &ns, int8_t leapS = UBXLEAPSECONDS )
+    {
+      if( !getunixnano( ns ) )
+        return false;
+
+      ns += ( leapS - ubxgpsepoch ) * ubxnsps;
+      return true;
+    }
+
+  private:
+    uint8_t *buffer;
+};
+
+class cfgtp5
+{
+  public:
+    typedef _cfgtp5hdr hdr;
+
+    cfgtp5( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    cfgtp5( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint16_t  getAntCableDelay() { return UBXGET( buffer, _cfgtp5, antCableDelay ); }
+    uint16_t  getRfGroupDelay() { return UBXGET( buffer, _cfgtp5, rfGroupDelay ); }
+    uint32_t  getFreqPeriod() { return UBXGET( buffer, _cfgtp5, freqPeriod ); }
+    uint32_t  getFreqPeriodLock() { return UBXGET( buffer, _cfgtp5, freqPeriodLock ); }
+    uint32_t  getPulseLenRatio() { return UBXGET( buffer, _cfgtp5, pulseLenRatio ); }
+    uint32_t  getPulseLenRatioLock() { return UBXGET( buffer, _cfgtp5, pulseLenRatioLock ); }
+    int32_t   getUserConfigDelay() { return UBXGET( buffer, _cfgtp5, userConfigDelay ); }
+    uint32_t  getFlags()  { return UBXGET( buffer, _cfgtp5, flags ); }
+
+    void setAntCableDelay( uint16_t  antCableDelay ) { UBXSET( buffer, _cfgtp5, antCableDelay, antCableDelay ); }
+    void setRfGroupDelay( uint16_t  rfGroupDelay ) { UBXSET( buffer, _cfgtp5, rfGroupDelay, rfGroupDelay ); }
+    void setFreqPeriod( uint32_t  freqPeriod ) { UBXSET( buffer, _cfgtp5, freqPeriod, freqPeriod ); }
+    void setFreqPeriodLock( uint32_t  freqPeriodLock ) { UBXSET( buffer, _cfgtp5, freqPeriodLock, freqPeriodLock ); }
+    void setPulseLenRatio( uint32_t  pulseLenRatio ) { UBXSET( buffer, _cfgtp5, pulseLenRatio, pulseLenRatio ); }
+    void setPulseLenRatioLock( uint32_t  pulseLenRatioLock ) { UBXSET( buffer, _cfgtp5, pulseLenRatioLock, pulseLenRatioLock ); }
+    void setUserConfigDelay( int32_t  userConfigDelay ) { UBXSET( buffer, _cfgtp5, userConfigDelay, userConfigDelay ); }
+    void setFlags( uint32_t  flags ) { UBXSET( buffer, _cfgtp5, flags, flags ); }
+
+    void configureTimePulse()
+    {
+      ubxsend( buffer, _cfgtp5hdr::length + 4 );
+    }
+
+  private:
+    uint8_t *buffer;
+};
+
+class navsat
+{
+  public:
+    typedef _navsathdr hdr;
+
+    navsat( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    navsat( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint8_t  getnumSvs() { return UBXGET( buffer, _navsat, intro.numSvs ); }
+    uint8_t  getgnssId( int satnum ) { return UBXBLOCKGET( buffer, _navsat, _navsatblock, satnum, gnssId ); }
+    uint8_t  getsvId( int satnum ) { return UBXBLOCKGET( buffer, _navsat, _navsatblock, satnum, svId ); }
+    uint8_t  getcno( int satnum ) { return UBXBLOCKGET( buffer, _navsat, _navsatblock, satnum, cno ); }
+    int8_t   getelev( int satnum ) { return UBXBLOCKGET( buffer, _navsat, _navsatblock, satnum, elev ); }
+    int16_t  getazim( int satnum ) { return UBXBLOCKGET( buffer, _navsat, _navsatblock, satnum, azim ); }
+    int16_t  getprRes( int satnum ) { return UBXBLOCKGET( buffer, _navsat, _navsatblock, satnum, prRes ); }
+    uint32_t getflags( int satnum ) { return UBXBLOCKGET( buffer, _navsat, _navsatblock, satnum, flags ); }
+
+    // This used to build the poll in the parser's buffer, on top of
+    // whatever packet was in it
+    static void pollNavsat()
+    {
+      ubxcommand<_navsathdr::cl, _navsathdr::id>::send();
+    }
+
+  private:
+    uint8_t *buffer;
+};
+
+class cfggnss
+{
+  public:
+    typedef _cfggnsshdr hdr;
+
+    cfggnss( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    cfggnss( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint8_t  getnumConfigBlocks() { return UBXGET( buffer, _cfggnss, intro.numConfigBlocks ); }
+    uint8_t  getgnssId( int blocknum ) { return UBXBLOCKGET( buffer, _cfggnss, _cfggnssblock, blocknum, gnssId ); }
+    uint32_t  getFlags( int blocknum ) { return UBXBLOCKGET( buffer, _cfggnss, _cfggnssblock, blocknum, flags ); }
+
+    void setFlags( int blocknum, uint32_t flags ) { UBXBLOCKSET( buffer, _cfggnss, _cfggnssblock, blocknum, flags, flags ); }
+
+    static void pollCfggnss()
+    {
+      ubxcommand<_cfggnsshdr::cl, _cfggnsshdr::id>::send();
+    }
+
+    void setCfggnss( int gnssId, bool enable )
+    {
+      if( enable )
+        setFlags( gnssId, getFlags( gnssId ) | 1 );
+      else
+        setFlags( gnssId, getFlags( gnssId ) & 0xFFFFFFFE );
+
+      ubxsend( buffer, UBXGET( buffer, _header, length ) + 4 );
+    }
+
+  private:
+    uint8_t *buffer;
+};
+
+class ack
+{
+  public:
+    typedef _ackhdr hdr;
+
+    ack( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    ack( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint8_t getclsId() { return UBXGET( buffer, _ack, clsId ); }
+    uint8_t getmsgId() { return UBXGET( buffer, _ack, msgId ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+class nak
+{
+  public:
+    typedef _nakhdr hdr;
+
+    nak( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    nak( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint8_t getclsId() { return UBXGET( buffer, _nak, clsId ); }
+    uint8_t getmsgId() { return UBXGET( buffer, _nak, msgId ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+class cfgmsg
+{
+  public:
+    typedef _cfgmsghdr hdr;
+
+    cfgmsg( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    cfgmsg( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint8_t  getMsgClass() { return UBXGET( buffer, _cfgmsg, msgClass ); }
+    uint8_t  getMsgId() { return UBXGET( buffer, _cfgmsg, msgId ); }
+    uint8_t  getRate( uint8_t port ) { return buffer[offsetof( _cfgmsg, rate ) + port]; }
+
+    void setRate( uint8_t port, uint8_t rate ) { buffer[offsetof( _cfgmsg, rate ) + port] = rate; }
+
+  private:
+    uint8_t *buffer;
+};
+
+class cfgprt
+{
+  public:
+    typedef _cfgprthdr hdr;
+
+    cfgprt( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    cfgprt( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint8_t   getPortId() { return UBXGET( buffer, _cfgprt, portID ); }
+    uint32_t  getMode() { return UBXGET( buffer, _cfgprt, mode ); }
+    uint32_t  getBaudRate() { return UBXGET( buffer, _cfgprt, baudRate ); }
+    uint16_t  getInProtoMask() { return UBXGET( buffer, _cfgprt, inProtoMask ); }
+    uint16_t  getOutProtoMask() { return UBXGET( buffer, _cfgprt, outProtoMask ); }
+
+    // The baud rate has no setter on purpose, ubxbaud changes it so that
+    // both ends follow
+    void setInProtoMask( uint16_t  inProtoMask ) { UBXSET( buffer, _cfgprt, inProtoMask, inProtoMask ); }
+    void setOutProtoMask( uint16_t  outProtoMask ) { UBXSET( buffer, _cfgprt, outProtoMask, outProtoMask ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+class cfgnav5
+{
+  public:
+    typedef _cfgnav5hdr hdr;
+
+    cfgnav5( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    cfgnav5( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint8_t   getDynModel() { return UBXGET( buffer, _cfgnav5, dynModel ); }
+    uint8_t   getFixMode() { return UBXGET( buffer, _cfgnav5, fixMode ); }
+    int8_t    getMinElev() { return UBXGET( buffer, _cfgnav5, minElev ); }
+    uint8_t   getUtcStandard() { return UBXGET( buffer, _cfgnav5, utcStandard ); }
+
+    void setDynModel( uint8_t  dynModel ) { UBXSET( buffer, _cfgnav5, dynModel, dynModel ); }
+    void setFixMode( uint8_t  fixMode ) { UBXSET( buffer, _cfgnav5, fixMode, fixMode ); }
+    void setMinElev( int8_t  minElev ) { UBXSET( buffer, _cfgnav5, minElev, minElev ); }
+    void setUtcStandard( uint8_t  utcStandard ) { UBXSET( buffer, _cfgnav5, utcStandard, utcStandard ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+class cfgrate
+{
+  public:
+    typedef _cfgratehdr hdr;
+
+    cfgrate( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    cfgrate( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint16_t  getMeasRate() { return UBXGET( buffer, _cfgrate, measRate ); }
+    uint16_t  getNavRate() { return UBXGET( buffer, _cfgrate, navRate ); }
+    uint16_t  getTimeRef() { return UBXGET( buffer, _cfgrate, timeRef ); }
+
+    void setMeasRate( uint16_t  measRate ) { UBXSET( buffer, _cfgrate, measRate, measRate ); }
+    void setNavRate( uint16_t  navRate ) { UBXSET( buffer, _cfgrate, navRate, navRate ); }
+    void setTimeRef( uint16_t  timeRef ) { UBXSET( buffer, _cfgrate, timeRef, timeRef ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+class naveoe
+{
+  public:
+    typedef _naveoehdr hdr;
+
+    naveoe( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    naveoe( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint32_t getiTOW() { return UBXGET( buffer, _naveoe, iTOW ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+class rxmrawx
+{
+  public:
+    typedef _rxmrawxhdr hdr;
+
+    rxmrawx( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    rxmrawx( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    double   getrcvTow() { return UBXGET( buffer + sizeof( _header ), _rxmrawxintro, rcvTow ); }
+    uint16_t getweek() { return UBXGET( buffer + sizeof( _header ), _rxmrawxintro, week ); }
+    int8_t   getleapS() { return UBXGET( buffer + sizeof( _header ), _rxmrawxintro, leapS ); }
+    uint8_t  getnumMeas() { return UBXGET( buffer + sizeof( _header ), _rxmrawxintro, numMeas ); }
+    uint8_t  getrecStat() { return UBXGET( buffer + sizeof( _header ), _rxmrawxintro, recStat ); }
+
+    // These need the whole packet, a streamed block is read with
+    // UBXGET( block, _rxmrawxblock, prMes ) and so on
+    double   getprMes( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, prMes ); }
+    double   getcpMes( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, cpMes ); }
+    float    getdoMes( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, doMes ); }
+    uint8_t  getgnssId( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, gnssId ); }
+    uint8_t  getsvId( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, svId ); }
+    uint8_t  getsigId( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, sigId ); }
+    uint16_t getlocktime( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, locktime ); }
+    uint8_t  getcno( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, cno ); }
+    uint8_t  gettrkStat( int meas ) { return UBXBLOCKGET( buffer, _rxmrawx, _rxmrawxblock, meas, trkStat ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+class rxmsfrbx
+{
+  public:
+    typedef _rxmsfrbxhdr hdr;
+
+    rxmsfrbx( _ubxpacket &gps )
+    {
+      buffer = gps.getbuffer();
+    };
+
+    rxmsfrbx( const ubxframe &frame )
+    {
+      buffer = frame.data;
+    };
+
+    uint8_t  getgnssId() { return UBXGET( buffer, _rxmsfrbx, intro.gnssId ); }
+    uint8_t  getsvId() { return UBXGET( buffer, _rxmsfrbx, intro.svId ); }
+    uint8_t  getfreqId() { return UBXGET( buffer, _rxmsfrbx, intro.freqId ); }
+    uint8_t  getnumWords() { return UBXGET( buffer, _rxmsfrbx, intro.numWords ); }
+    uint8_t  getchn() { return UBXGET( buffer, _rxmsfrbx, intro.chn ); }
+    uint32_t getdwrd( int word ) { return ubxget<uint32_t>( buffer + sizeof( _rxmsfrbx ) + word * 4 ); }
+
+  private:
+    uint8_t *buffer;
+};
+
+// The parser for every packet above. A node that only needs some of them
+// can have its own, e.g. ubxparser<true, navpvt8, ack, nak>, with a buffer
+// only as long as the longest of those. RXM-RAWX is left out as it can be
+// longer than the buffer, stream it into a ubxraw instead.
+typedef ubxparser<UBXSTATS != 0, navpvt7, navpvt8, cfgtp5, ack, nak, navsat, cfggnss, cfgmsg, cfgprt, cfgnav5, cfgrate, rxmsfrbx, naveoe> ublox;
+
+// The accessors are views of a packet that lives somewhere else, keep them
+// that way so they can be made wherever they are needed
+static_assert( sizeof( navpvt7 ) == sizeof( uint8_t * ), "navpvt7 should only hold a pointer" );
+static_assert( sizeof( navpvt8 ) == sizeof( uint8_t * ), "navpvt8 should only hold a pointer" );
+static_assert( sizeof( cfgtp5 ) == sizeof( uint8_t * ), "cfgtp5 should only hold a pointer" );
+static_assert( sizeof( navsat ) == sizeof( uint8_t * ), "navsat should only hold a pointer" );
+static_assert( sizeof( cfggnss ) == sizeof( uint8_t * ), "cfggnss should only hold a pointer" );
+static_assert( sizeof( ack ) == sizeof( uint8_t * ), "ack should only hold a pointer" );
+static_assert( sizeof( nak ) == sizeof( uint8_t * ), "nak should only hold a pointer" );
+static_assert( sizeof( cfgmsg ) == sizeof( uint8_t * ), "cfgmsg should only hold a pointer" );
+static_assert( sizeof( cfgprt ) == sizeof( uint8_t * ), "cfgprt should only hold a pointer" );
+static_assert( sizeof( cfgnav5 ) == sizeof( uint8_t * ), "cfgnav5 should only hold a pointer" );
+static_assert( sizeof( cfgrate ) == sizeof( uint8_t * ), "cfgrate should only hold a pointer" );
+static_assert( sizeof( naveoe ) == sizeof( uint8_t * ), "naveoe should only hold a pointer" );
+static_assert( sizeof( rxmrawx ) == sizeof( uint8_t * ), "rxmrawx should only hold a pointer" );
+static_assert( sizeof( rxmsfrbx ) == sizeof( uint8_t * ), "rxmsfrbx should only hold a pointer" );
+
+// *** Message store
+// Keeps the latest copy of each packet type so that a NAV-SAT arriving
+// right after a NAV-PVT doesn't overwrite the fix before it has been read.
+// List the accessor classes to keep, wrapping any that should be double
+// buffered in ubxdouble<>, and attach the store to the parser:
+//
+//   ubxstore<navpvt8, ubxdouble<navsat>, cfgtp5> store;
+//   gps.attach( store );
+//   ...
+//   navpvt8 nav = store.get<navpvt8>();
+//
+// get<>() doesn't copy anything, it is a view of the slot. A single
+// buffered slot is rewritten when the next packet of that type arrives so
+// read it from the same task as the parser. A double buffered slot is
+// written on the side and then swapped in, so a reader in another task can
+// use it for a whole message period; getsequence<>() changes every time a
+// new packet is stored if the reader needs to check.
+
+template<class T>
+struct ubxdouble
+{
+};
+
+template<class T>
+struct _ubxcopies
+{
+  typedef T type;
+  static constexpr uint8_t copies = 1;
+};
+
+template<class T>
+struct _ubxcopies< ubxdouble<T> >
+{
+  typedef T type;
+  static constexpr uint8_t copies = 2;
+};
+
+template<class T, uint8_t C>
+struct _ubxcell
+{
+  uint8_t data[C][T::hdr::maxlength + sizeof( _header )];
+  uint16_t length[C];
+  std::atomic<uint8_t> front{ 0 };
+  std::atomic<uint32_t> sequence{ 0 };
+
+  void put( const ubxframe &frame )
+  {
+    if( frame.message != T::hdr::message || frame.length > sizeof( data[0] ) )
+      return;
+
+    uint8_t back = C == 1 ? 0 : front.load( std::memory_order_relaxed ) ^ 1;
+
+    memcpy( data[back], frame.data, frame.length );
+    length[back] = frame.length;
+
+    // the packet has to be there before it is published
+    front.store( back, std::memory_order_release );
+    sequence.store( sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+  };
+};
+
+template<typename... M>
+class ubxstore : public ubxlistener, public _ubxcell<typename _ubxcopies<M>::type, _ubxcopies<M>::copies>...
+{
+  public:
+    void onframe( const ubxframe &frame ) override
+    {
+      int each[] = { 0, ( cell<M>().put( frame ), 0 )... };
+      (void)each;
+    };
+
+    // True once a packet of this type has been received
+    template<class T>
+    bool has()
+    {
+      return pick<T>( *this ).sequence.load( std::memory_order_acquire ) != 0;
+    };
+
+    template<class T>
+    uint32_t getsequence()
+    {
+      return pick<T>( *this ).sequence.load( std::memory_order_acquire );
+    };
+
+    template<class T>
+    T get()
+    {
+      auto &c = pick<T>( *this );
+      uint8_t f = c.front.load( std::memory_order_acquire );
+      ubxframe frame = { T::hdr::message, c.data[f], c.length[f] };
+
+      return T( frame );
+    };
+
+  private:
+    template<class E>
+    _ubxcell<typename _ubxcopies<E>::type, _ubxcopies<E>::copies> &cell()
+    {
+      return *this;
+    };
+
+    template<class T, uint8_t C>
+    static _ubxcell<T, C> &pick( _ubxcell<T, C> &c )
+    {
+      return c;
+    };
+};
+
+// *** Frame queue
+// A bounded lock free queue of complete packets between one task that
+// reads the serial port and parses, and one task that does the slow stuff
+// (the OLED in esp32oled.cpp takes around 20ms to update). Attach it to the
+// parser and drain it from the other task:
+//
+//   ubxqueue<4096> queue;
+//   gps.attach( queue );
+//   ...
+//   ubxframe frame;
+//   while( queue.front( frame ) )
+//   {
+//     if( frame.message == Message::navpvt8 )
+//     {
+//       navpvt8 nav( frame );
+//       ...
+//     }
+//     queue.pop();
+//   }
+//
+// Packets are stored one after the other, each behind a 4 byte record
+// header, so small packets don't waste a 1K slot. When the queue is full
+// the new packet is dropped and counted, the consumer is never blocked.
+// Size must be a power of 2.
+
+template<size_t Size>
+class ubxqueue : public ubxlistener
+{
+  static_assert( ( Size & ( Size - 1 ) ) == 0 && Size >= 64, "queue size must be a power of 2" );
+
+  public:
+    ubxqueue() : head( 0 ), tail( 0 ), pushed( 0 ), overflows( 0 )
+    {
+    };
+
+    // Producer side, called by the parser for every good packet
+    void onframe( const ubxframe &frame ) override
+    {
+      push( frame );
+    };
+
+    bool push( const ubxframe &frame )
+    {
+      uint32_t h = head.load( std::memory_order_relaxed );
+      uint32_t space = Size - ( h - tail.load( std::memory_order_acquire ) );
+      uint32_t need = record( frame.length );
+      uint32_t pos = h & ( Size - 1 );
+      uint32_t skip = pos + need > Size ? Size - pos : 0;  // no room before the end so start again at 0
+
+      if( skip + need > space )
+      {
+        overflows.store( overflows.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+        return false;
+      }
+
+      if( skip )
+      {
+        setrecord( pos, wrap, Message::none );
+        h += skip;
+        pos = 0;
+      }
+
+      setrecord( pos, frame.length, frame.message );
+      memcpy( &data[pos + 4], frame.data, frame.length );
+
+      head.store( h + need, std::memory_order_release );
+      pushed.store( pushed.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+
+      return true;
+    };
+
+    // Consumer side. front() gives the oldest packet, which stays valid
+    // until pop() is called
+    bool front( ubxframe &frame )
+    {
+      uint32_t t = tail.load( std::memory_order_relaxed );
+
+      for( ;; )
+      {
+        if( t == head.load( std::memory_order_acquire ) )
+          return false;
+
+        uint32_t pos = t & ( Size - 1 );
+        uint16_t length;
+
+        memcpy( &length, &data[pos], 2 );
+
+        if( length != wrap )
+        {
+          frame.message = (Message)data[pos + 2];
+          frame.data = &data[pos + 4];
+          frame.length = length;
+          return true;
+        }
+
+        t += Size - pos;
+        tail.store( t, std::memory_order_release );
+      }
+    };
+
+    void pop()
+    {
+      ubxframe frame;
+
+      if( front( frame ) )
+        tail.store( tail.load( std::memory_order_relaxed ) + record( frame.length ), std::memory_order_release );
+    };
+
+    bool empty()
+    {
+      return tail.load( std::memory_order_relaxed ) == head.load( std::memory_order_acquire );
+    };
+
+    uint32_t getpushed()
+    {
+      return pushed.load( std::memory_order_relaxed );
+    };
+
+    // Packets dropped because the consumer didn't keep up
+    uint32_t getoverflows()
+    {
+      return overflows.load( std::memory_order_relaxed );
+    };
+
+  private:
+    static constexpr uint16_t wrap = 0xFFFF;  // record header marking the unused end of the queue
+
+    static uint32_t record( uint16_t length )
+    {
+      return ( 4 + length + 3 ) & ~3u;  // keep every record 4 byte aligned
+    };
+
+    void setrecord( uint32_t pos, uint16_t length, Message message )
+    {
+      memcpy( &data[pos], &length, 2 );
+      data[pos + 2] = (uint8_t)message;
+      data[pos + 3] = 0;
+    };
+
+    alignas( 4 ) uint8_t data[Size];
+    std::atomic<uint32_t> head;   // written by the producer only
+    std::atomic<uint32_t> tail;   // written by the consumer only
+    std::atomic<uint32_t> pushed;
+    std::atomic<uint32_t> overflows;
+};
+
+// *** Epoch assembler
+// Puts the NAV packets of one navigation solution together and hands them
+// over once, as one record, instead of one packet at a time. Packets are
+// grouped by iTOW and the epoch closes when NAV-EOE comes (turn it on with
+// enableNavEoe()), when every packet expected has arrived, or when a NAV
+// packet of the next solution shows up first:
+//
+//   void onepoch( const ubxepoch<navpvt8, navsat> &epoch, void *context )
+//   {
+//     if( epoch.has<navpvt8>() ) { navpvt8 nav = epoch.get<navpvt8>(); ... }
+//   }
+//   ubxepoch<navpvt8, navsat> epoch( onepoch );
+//   gps.attach( epoch );
+//
+// Every packet listed is expected unless expect<>() says otherwise, e.g.
+// epoch.expect<navpvt8>() with NAV-SAT at a lower rate, or expect<>() to
+// wait for NAV-EOE. A listed packet that comes after its epoch has been
+// handed over (NAV-SAT behind NAV-PVT with expect<navpvt8>()) is added and
+// the same record handed over again, so the handler may see an iTOW twice,
+// the second time with more in it. Repeats of a packet already handed over
+// are ignored. The record doesn't change while the handler has it, so a
+// handler never sees two solutions mixed.
+
+template<typename... M>
+class ubxepoch : public ubxlistener, public _ubxcell<M, 1>...
+{
+  static_assert( _ubxsum( ( M::hdr::cl == 0x01 )... ) == sizeof...( M ), "only NAV packets have an iTOW to group them by" );
+  static_assert( sizeof...( M ) <= 32, "too many packets in one epoch" );
+
+  public:
+    typedef ubxregistry<typename M::hdr...> registry;
+    typedef void (*epochcallback)( const ubxepoch &epoch, void *context );
+
+    ubxepoch( epochcallback cb, void *ctx = nullptr )
+    {
+      callback = cb;
+      context = ctx;
+      expected = sizeof...( M ) == 32 ? 0xFFFFFFFF : ( 1u << sizeof...( M ) ) - 1;
+      present = 0;
+      open = false;
+      closed = false;
+      iTOW = 0;
+      epochs = 0;
+      late = 0;
+    };
+
+    // Close an epoch as soon as these have arrived
+    template<class... T>
+    void expect()
+    {
+      uint32_t bits[] = { 0, ( 1u << registry::template indexof<typename T::hdr>() )... };
+
+      expected = 0;
+
+      for( uint8_t i = 0; i < sizeof( bits ) / sizeof( bits[0] ); i++ )
+        expected |= bits[i];
+    };
+
+    void onframe( const ubxframe &frame ) override
+    {
+      if( frame.data[0] != 0x01 || frame.length < sizeof( _header ) + 4 )
+        return;
+
+      uint32_t t = ubxget<uint32_t>( frame.data + sizeof( _header ) );
+
+      if( open && t != iTOW )
+        close();
+
+      if( frame.message == Message::naveoe )
+      {
+        if( open )
+          close();
+
+        return;
+      }
+
+      int i = registry::find( frame.data[0], frame.data[1], frame.length - sizeof( _header ) );
+
+      if( i < 0 )
+        return;
+
+      if( closed && t == iTOW )
+      {
+        if( present & ( 1u << i ) )
+          return;  // a repeat of what has been handed over already
+
+        // late for its epoch, hand the record over again with it
+        int each[] = { 0, ( cell<M>().put( frame ), 0 )... };
+        (void)each;
+
+        present |= 1u << i;
+        late++;
+
+        if( callback )
+          callback( *this, context );
+
+        return;
+      }
+
+      if( !open )
+        present = 0;
+
+      int each[] = { 0, ( cell<M>().put( frame ), 0 )... };
+      (void)each;
+
+      open = true;
+      closed = false;
+      iTOW = t;
+      present |= 1u << i;
+
+      if( expected && ( present & expected ) == expected )
+        close();
+    };
+
+    // What the handler can look at
+
+    uint32_t getiTOW() const
+    {
+      return iTOW;
+    };
+
+    template<class T>
+    bool has() const
+    {
+      return present & ( 1u << registry::template indexof<typename T::hdr>() );
+    };
+
+    template<class T>
+    T get() const
+    {
+      const _ubxcell<T, 1> &c = *this;
+      ubxframe frame = { T::hdr::message, const_cast<uint8_t *>( c.data[0] ), c.length[0] };
+
+      return T( frame );
+    };
+
+    // Epochs handed over
+    uint32_t getepochs() const
+    {
+      return epochs;
+    };
+
+    // Packets that came after their epoch had been handed over
+    uint32_t getlate() const
+    {
+      return late;
+    };
+
+  private:
+    template<class E>
+    _ubxcell<E, 1> &cell()
+    {
+      return *this;
+    };
+
+    void close()
+    {
+      open = false;
+      closed = true;
+      epochs++;
+
+      if( callback )
+        callback( *this, context );
+    };
+
+    epochcallback callback;
+    void *context;
+    uint32_t expected;
+    uint32_t present;
+    bool open;
+    bool closed;      // iTOW has been handed over
+    uint32_t iTOW;
+    uint32_t epochs;
+    uint32_t late;
+};
+
+// *** Raw measurements
+// RXM-RAWX epochs kept for post processing, streamed straight out of the
+// parser into preallocated arrays. There is one array per field (structure
+// of arrays) and the signals of an epoch are next to each other in all of
+// them, so an epoch is a range of indexes:
+//
+//   ubxraw<> raw;
+//   raw.attach( gps );
+//   enableRxmRawx();
+//   ...
+//   while( raw.available() )
+//   {
+//     const ubxrawepoch &e = raw.front();
+//
+//     for( uint16_t i = e.first; i < e.first + e.count; i++ )
+//       ... raw.prMes[i], raw.cpMes[i], raw.svId[i] ...
+//
+//     raw.pop();
+//   }
+//
+// Like ubxqueue it is lock free for one task parsing and another taking
+// the epochs. An epoch that doesn't fit, or whose checksum turns out to
+// be bad, is dropped and counted and the parser is never held up.
+
+struct ubxrawepoch
+{
+  double    rcvTow;   // receiver time of week in s
+  uint16_t  week;
+  int8_t    leapS;
+  uint8_t   recStat;
+  uint16_t  first;    // index of its first signal in the arrays
+  uint8_t   count;    // number of signals
+};
+
+template<uint16_t Signals = 256, uint8_t Epochs = 8>
+class ubxraw
+{
+  public:
+    ubxraw() : written( 0 ), read( 0 ), dropped( 0 )
+    {
+      head = 0;
+      pos = 0;
+      reserved = 0;
+      filled = 0;
+      streaming = false;
+    };
+
+    template<class P>
+    bool attach( P &parser )
+    {
+      return parser.template stream<rxmrawx>( &ubxraw::onblock, &ubxraw::onend, this );
+    };
+
+    // Consumer side. front() gives the oldest epoch, which stays valid
+    // until pop() is called
+    uint8_t available()
+    {
+      return written.load( std::memory_order_acquire ) - read.load( std::memory_order_relaxed );
+    };
+
+    const ubxrawepoch &front()
+    {
+      return epochs[read.load( std::memory_order_relaxed ) % Epochs];
+    };
+
+    void pop()
+    {
+      if( available() )
+        read.store( read.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    };
+
+    // Epochs lost because there was no room or the packet was bad
+    uint32_t getdropped()
+    {
+      return dropped.load( std::memory_order_relaxed );
+    };
+
+    double    prMes[Signals];
+    double    cpMes[Signals];
+    float     doMes[Signals];
+    uint16_t  locktime[Signals];
+    uint8_t   gnssId[Signals];
+    uint8_t   svId[Signals];
+    uint8_t   sigId[Signals];
+    uint8_t   freqId[Signals];
+    uint8_t   cno[Signals];
+    uint8_t   prStdev[Signals];
+    uint8_t   cpStdev[Signals];
+    uint8_t   doStdev[Signals];
+    uint8_t   trkStat[Signals];
+
+  private:
+    static void onblock( rxmrawx &raw, const uint8_t *block, uint16_t index, void *ctx )
+    {
+      ubxraw &r = *(ubxraw *)ctx;
+
+      if( index == 0 )
+      {
+        r.streaming = r.reserve( raw.getnumMeas() );
+        r.filled = 0;
+      }
+
+      if( !r.streaming || index >= r.reserved )
+        return;
+
+      uint16_t i = r.pos + index;
+
+      r.filled = index + 1;
+      r.prMes[i] = UBXGET( block, _rxmrawxblock, prMes );
+      r.cpMes[i] = UBXGET( block, _rxmrawxblock, cpMes );
+      r.doMes[i] = UBXGET( block, _rxmrawxblock, doMes );
+      r.locktime[i] = UBXGET( block, _rxmrawxblock, locktime );
+      r.gnssId[i] = UBXGET( block, _rxmrawxblock, gnssId );
+      r.svId[i] = UBXGET( block, _rxmrawxblock, svId );
+      r.sigId[i] = UBXGET( block, _rxmrawxblock, sigId );
+      r.freqId[i] = UBXGET( block, _rxmrawxblock, freqId );
+      r.cno[i] = UBXGET( block, _rxmrawxblock, cno );
+      r.prStdev[i] = UBXGET( block, _rxmrawxblock, prStdev ) & 15;
+      r.cpStdev[i] = UBXGET( block, _rxmrawxblock, cpStdev ) & 15;
+      r.doStdev[i] = UBXGET( block, _rxmrawxblock, doStdev ) & 15;
+      r.trkStat[i] = UBXGET( block, _rxmrawxblock, trkStat );
+    };
+
+    // The epoch only becomes visible here, once its checksum is good
+    static void onend( rxmrawx &raw, bool good, void *ctx )
+    {
+      ubxraw &r = *(ubxraw *)ctx;
+
+      if( raw.getnumMeas() == 0 )
+      {
+        r.streaming = good && r.reserve( 0 );  // no blocks so no onblock()
+        r.filled = 0;
+      }
+
+      if( !good || !r.streaming )
+      {
+        r.dropped.store( r.dropped.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+        r.streaming = false;
+        return;
+      }
+
+      uint32_t w = r.written.load( std::memory_order_relaxed );
+      ubxrawepoch &e = r.epochs[w % Epochs];
+
+      e.rcvTow = raw.getrcvTow();
+      e.week = raw.getweek();
+      e.leapS = raw.getleapS();
+      e.recStat = raw.getrecStat();
+      e.first = r.pos;
+      e.count = r.filled;  // less than numMeas if the packet was short
+
+      r.head = r.pos + r.filled;
+      r.streaming = false;
+      r.written.store( w + 1, std::memory_order_release );
+    };
+
+    // Find room for n signals behind the last epoch, or at the start of
+    // the arrays if the end is too close. The signals in use run from the
+    // oldest epoch not yet popped that has any up to head, possibly
+    // wrapping. Empty epochs take no room, otherwise head == tail behind
+    // one would look like full arrays.
+    bool reserve( uint8_t n )
+    {
+      uint32_t w = written.load( std::memory_order_relaxed );
+      uint32_t r = read.load( std::memory_order_acquire );
+
+      if( w - r == Epochs )
+        return false;
+
+      while( r != w && epochs[r % Epochs].count == 0 )
+        r++;
+
+      uint16_t tail = epochs[r % Epochs].first;
+
+      if( w == r || head > tail )
+      {
+        if( head + n <= Signals )
+          pos = head;
+        else if( w == r || n <= tail )
+          pos = 0;
+        else
+          return false;
+      }
+      else if( head + n <= tail )
+        pos = head;
+      else
+        return false;
+
+      reserved = n;
+      return true;
+    };
+
+    ubxrawepoch epochs[Epochs];
+    std::atomic<uint32_t> written;  // epochs, written by the producer only
+    std::atomic<uint32_t> read;     // written by the consumer only
+    std::atomic<uint32_t> dropped;
+    uint16_t head;      // where the signals of the last epoch end
+    uint16_t pos;       // where the epoch being streamed goes
+    uint8_t reserved;
+    uint8_t filled;     // signals of it streamed so far
+    bool streaming;
+};
+
+// *** Protocol demultiplexer
+// Sits in front of the parser when the receiver sends NMEA (and RTCM3)
+// as well as UBX, so NMEA doesn't have to be turned off with disableNmea().
+// Every byte is looked at once for the start of a UBX (0xB5 0x62), NMEA
+// ('$' ... '*hh\r\n') or RTCM3 (0xD3) frame. A frame is kept until it is
+// complete and its checksum (or CRC) is good, then it goes to its handler.
+// When a frame turns out bad the search starts again from the byte after
+// its start, so a false start (a '$' or 0xD3 that is just data) costs time
+// but no bytes. Good UBX frames are handed to the parser where they sit,
+// through the zero copy version of parse(), so use only this for input.
+// A UBX frame too long to keep (RXM-RAWX with many signals, say) goes
+// straight to the parser as it arrives if the parser streams it, and the
+// parser checks it. Such a frame costs its bytes if it turns out bad. Any
+// other frame longer than UBXDEMUXSIZE is taken as a false start.
+//
+//   ubxdemux<> demux( gps );
+//   demux.onnmea( shownmea );
+//   ...
+//   demux.parse( chunk, n );
+
+#ifndef UBXDEMUXSIZE
+#define UBXDEMUXSIZE 1040   // longest frame kept, RTCM3 frames can be 1029 bytes
+#endif
+
+#ifndef UBXNMEAMAX
+#define UBXNMEAMAX 120      // NMEA says 82 but some u-blox sentences are longer
+#endif
+
+// The sentence includes the '$' and the "\r\n", it is not 0 terminated
+typedef void (*nmeacallback)( const char *sentence, uint16_t length, void *context );
+
+// The whole RTCM3 frame, from the 0xD3 to the end of the CRC
+typedef void (*rtcmcallback)( const uint8_t *frame, uint16_t length, void *context );
+
+template<class Parser = ublox>
+class ubxdemux
+{
+  static_assert( UBXDEMUXSIZE > 3 + 1023 + 3, "RTCM3 frames would not fit" );
+  static_assert( UBXDEMUXSIZE > 2 + sizeof( _header ) + Parser::registry::longest + 2, "the parser's longest packet would not fit, raise UBXDEMUXSIZE" );
+
+  public:
+    ubxdemux( Parser &parser ) : gps( parser )
+    {
+      count = 0;
+      need = 0;
+      scanned = 0;
+      through = 0;
+      errors = 0;
+      nmea = nullptr;
+      nmeacontext = nullptr;
+      rtcm = nullptr;
+      rtcmcontext = nullptr;
+      ubxframes = 0;
+      nmeaframes = 0;
+      rtcmframes = 0;
+      falsestarts = 0;
+      discarded = 0;
+    };
+
+    void onnmea( nmeacallback cb, void *ctx = nullptr )
+    {
+      nmea = cb;
+      nmeacontext = ctx;
+    };
+
+    void onrtcm( rtcmcallback cb, void *ctx = nullptr )
+    {
+      rtcm = cb;
+      rtcmcontext = ctx;
+    };
+
+    // Returns the number of frames of any kind completed in the chunk
+    size_t parse( const uint8_t *data, size_t len )
+    {
+      const uint8_t *end = data + len;
+      size_t frames = 0;
+
+      while( data < end )
+      {
+        if( through )
+        {
+          size_t n = through < (size_t)( end - data ) ? through : end - data;
+
+          gps.parse( data, n );
+          through -= n;
+          data += n;
+
+          // a bad one is counted by the parser as a checksum error
+          if( through == 0 && gps.getchecksumerrors() == errors )
+          {
+            ubxframes++;
+            frames++;
+          }
+          continue;
+        }
+
+        if( count == 0 )
+        {
+          const uint8_t *s = data;
+
+          while( s < end && !start( *s ) )
+            s++;
+
+          discarded += s - data;
+          data = s;
+
+          if( data == end )
+            break;
+
+          begin( *data );
+        }
+
+        size_t n = need - count;
+
+        if( n > (size_t)( end - data ) )
+          n = end - data;
+
+        // a sentence ends at the first '\n', what follows may be anything
+        if( ( count ? buffer[0] : *data ) == '$' )
+        {
+          const uint8_t *nl = (const uint8_t *)memchr( data, '\n', n );
+
+          if( nl )
+            n = nl - data + 1;
+        }
+
+        memcpy( &buffer[count], data, n );
+        count += n;
+        data += n;
+
+        frames += check();
+      }
+
+      return frames;
+    };
+
+    uint32_t getubx()
+    {
+      return ubxframes;
+    };
+
+    uint32_t getnmea()
+    {
+      return nmeaframes;
+    };
+
+    uint32_t getrtcm()
+    {
+      return rtcmframes;
+    };
+
+    // Frame starts that came to nothing, and bytes that were not in any frame
+    uint32_t getfalsestarts()
+    {
+      return falsestarts;
+    };
+
+    uint32_t getdiscarded()
+    {
+      return discarded;
+    };
+
+  private:
+    static bool start( uint8_t c )
+    {
+      return c == 0xB5 || c == '$' || c == 0xD3;
+    };
+
+    // How much of a frame to read before looking at it
+    void begin( uint8_t c )
+    {
+      need = c == 0xB5 ? 2 + sizeof( _header ) : c == 0xD3 ? 3 : UBXNMEAMAX;
+      scanned = 1;
+    };
+
+    // Look at what has been kept, pass on any complete frames and look for
+    // another start if a frame is bad
+    size_t check()
+    {
+      size_t frames = 0;
+
+      for( ;; )
+      {
+        int n = complete();
+
+        if( n == 0 )
+          return frames;
+
+        size_t i;
+
+        if( n > 0 )
+        {
+          frames++;
+          route( n );
+          i = n;
+        }
+        else
+        {
+          falsestarts++;
+          i = 1;
+        }
+
+        size_t from = i;
+
+        while( i < count && !start( buffer[i] ) )
+          i++;
+
+        discarded += n > 0 ? i - from : i;
+        count -= i;
+        memmove( buffer, &buffer[i], count );
+
+        if( count == 0 )
+          return frames;
+
+        begin( buffer[0] );
+      }
+    };
+
+    // The length of the frame at the start of the buffer if it is complete
+    // and good, 0 if more is needed or -1 if it is bad
+    int complete()
+    {
+      if( buffer[0] == '$' )
+        return sentence();
+
+      if( buffer[0] == 0xD3 )
+      {
+        if( count < 3 )
+          return 0;
+
+        if( buffer[1] & 0xFC )  // reserved bits
+          return -1;
+
+        size_t n = 3 + ( ( buffer[1] & 3 ) << 8 | buffer[2] ) + 3;
+
+        if( count < n )
+        {
+          need = n;
+          return 0;
+        }
+
+        uint32_t crc = (uint32_t)buffer[n - 3] << 16 | buffer[n - 2] << 8 | buffer[n - 1];
+
+        return crc24q( buffer, n - 3 ) == crc ? (int)n : -1;
+      }
+
+      if( count < 2 + sizeof( _header ) )
+        return buffer[1] == 0x62 || count < 2 ? 0 : -1;
+
+      if( buffer[1] != 0x62 || !ubxclass( buffer[2] ) )
+        return -1;
+
+      size_t n = 2 + sizeof( _header ) + ( buffer[4] | buffer[5] << 8 ) + 2;
+
+      if( n >= sizeof( buffer ) )
+      {
+        if( !gps.isstreamed( ubxheader( &buffer[2] ) ) )
+          return -1;
+
+        // The parser takes it from here, what is kept goes first. It gets
+        // the whole frame from the sync bytes on, so whichever parse() it
+        // is fed with next it is back where it started.
+        errors = gps.getchecksumerrors();
+        gps.parse( buffer, count );
+        through = n - count;
+        count = 0;
+        return 0;
+      }
+
+      if( count < n )
+      {
+        need = n;
+        return 0;
+      }
+
+      uint8_t ck[2] = { 0, 0 };
+
+      ubxchecksum( ck, &buffer[2], n - 4 );
+
+      return ck[0] == buffer[n - 2] && ck[1] == buffer[n - 1] ? (int)n : -1;
+    };
+
+    // NMEA is printable ASCII up to "*hh\r\n" where hh is the exclusive or
+    // of everything between the '$' and the '*'
+    int sentence()
+    {
+      for( ; scanned < count; scanned++ )
+      {
+        uint8_t c = buffer[scanned];
+
+        if( c == '\n' )
+        {
+          size_t n = scanned + 1;
+
+          if( n < 6 || buffer[n - 5] != '*' || buffer[n - 2] != '\r' )
+            return -1;
+
+          uint8_t x = 0;
+
+          for( size_t i = 1; i < n - 5; i++ )
+            x ^= buffer[i];
+
+          return hex( buffer[n - 4] ) == ( x >> 4 ) && hex( buffer[n - 3] ) == ( x & 15 ) ? (int)n : -1;
+        }
+
+        if( c == '$' || ( ( c < 0x20 || c > 0x7E ) && c != '\r' ) )
+          return -1;
+      }
+
+      return count < UBXNMEAMAX ? 0 : -1;
+    };
+
+    static int hex( uint8_t c )
+    {
+      return c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    };
+
+    static uint32_t crc24q( const uint8_t *p, size_t n )
+    {
+      uint32_t crc = 0;
+
+      for( size_t i = 0; i < n; i++ )
+      {
+        crc ^= (uint32_t)p[i] << 16;
+
+        for( uint8_t b = 0; b < 8; b++ )
+        {
+          crc <<= 1;
+
+          if( crc & 0x1000000 )
+            crc ^= 0x1864CFB;
+        }
+      }
+
+      return crc & 0xFFFFFF;
+    };
+
+    void route( size_t n )
+    {
+      if( buffer[0] == 0xB5 )
+      {
+        size_t tail = 0;
+
+        ubxframes++;
+        gps.parse( buffer, sizeof( buffer ), tail, n );
+      }
+      else if( buffer[0] == '$' )
+      {
+        nmeaframes++;
+
+        if( nmea )
+          nmea( (const char *)buffer, n, nmeacontext );
+      }
+      else
+      {
+        rtcmframes++;
+
+        if( rtcm )
+          rtcm( buffer, n, rtcmcontext );
+      }
+    };
+
+    Parser &gps;
+    uint8_t buffer[UBXDEMUXSIZE];
+    size_t count;
+    size_t need;
+    size_t scanned;   // how far into a sentence has been checked
+    size_t through;   // bytes of a streamed UBX frame still to pass on
+    uint32_t errors;  // the parser's checksum errors before that frame
+    nmeacallback nmea;
+    void *nmeacontext;
+    rtcmcallback rtcm;
+    void *rtcmcontext;
+    uint32_t ubxframes;
+    uint32_t nmeaframes;
+    uint32_t rtcmframes;
+    uint32_t falsestarts;
+    uint32_t discarded;
+};
+
+// *** Command queue
+// Sends CFG commands without waiting around. Each command is sent, the
+// matching ACK-ACK or ACK-NAK (by class and id) completes it and if
+// neither comes it is sent again, and after the last try it times out.
+// Commands go out in the order they were added and several are in flight
+// at once, except that two with the same class and id never are, as
+// their replies couldn't be told apart. One held back for that doesn't
+// hold up the others behind it. Attach it to the parser (which
+// must know ack and nak) and call update() from the loop:
+//
+//   ubxcommands<> commands;
+//   gps.attach( commands );
+//   commands.add<cfgnmeaoff>();
+//   commands.add<cfgnavpvton>();
+//   ...
+//   commands.update( millis() );
+//
+// Frames are not copied, so they must stay where they are until their
+// reply. The constant commands are in flash so that is always true.
+
+#ifndef UBXCMDTIMEOUT
+#define UBXCMDTIMEOUT 250   // ms to wait for an ACK before sending again
+#endif
+
+#ifndef UBXCMDTRIES
+#define UBXCMDTRIES 3       // sends before giving up
+#endif
+
+#ifndef UBXCMDWINDOW
+#define UBXCMDWINDOW 4      // commands in flight at once
+#endif
+
+enum class Reply : uint8_t { ack, nak, timeout };
+
+// ticket is what add() returned for the command
+typedef void (*replycallback)( uint32_t ticket, uint8_t cl, uint8_t id, Reply reply, void *context );
+
+template<uint8_t Slots = 32>
+class ubxcommands : public ubxlistener
+{
+  public:
+    ubxcommands()
+    {
+      memset( slots, 0, sizeof( slots ) );
+      tickets = 0;
+      inflight = 0;
+      callback = nullptr;
+      context = nullptr;
+      acks = 0;
+      naks = 0;
+      timeouts = 0;
+    };
+
+    void onreply( replycallback cb, void *ctx = nullptr )
+    {
+      callback = cb;
+      context = ctx;
+    };
+
+    // Queue one or more complete frames (sync to checksum) one after the
+    // other, each becomes its own command. Returns the ticket of the last
+    // one, or 0 and nothing queued if they didn't all fit.
+    uint32_t add( const uint8_t *frames, uint16_t length )
+    {
+      uint32_t ticket = 0;
+      uint8_t room = 0;
+      uint8_t count = 0;
+
+      for( uint8_t i = 0; i < Slots; i++ )
+        room += slots[i].state == empty;
+
+      // all of them have to fit before any is queued
+
+      for( uint16_t at = 0; at < length; count++ )
+      {
+        uint16_t left = length - at;
+
+        if( left < 2 + sizeof( _header ) + 2 || count == room )
+          return 0;
+
+        uint32_t n = 2 + sizeof( _header ) + ( frames[at + 4] | frames[at + 5] << 8 ) + 2;
+
+        if( n > left )
+          return 0;
+
+        at += n;
+      }
+
+      while( count-- )
+      {
+        uint16_t n = 2 + sizeof( _header ) + ( frames[4] | frames[5] << 8 ) + 2;
+        _ubxslot *s = freeslot();
+
+        s->frame = frames;
+        s->length = n;
+        s->state = queued;
+        s->tries = 0;
+        s->ticket = ticket = ++tickets;
+
+        frames += n;
+        length -= n;
+      }
+
+      return ticket;
+    };
+
+    template<class C>
+    uint32_t add()
+    {
+      return add( C::data, sizeof( C::data ) );
+    };
+
+    // Sends what can be sent and retries or gives up on what has been
+    // waiting too long. now is in ms, e.g. millis()
+    void update( uint32_t now )
+    {
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        _ubxslot &s = slots[i];
+
+        if( s.state == sent && now - s.time >= UBXCMDTIMEOUT )
+        {
+          if( s.tries < UBXCMDTRIES )
+            transmit( s, now );
+          else
+            finish( s, Reply::timeout );
+        }
+      }
+
+      while( inflight < UBXCMDWINDOW )
+      {
+        _ubxslot *s = next();
+
+        if( s == nullptr )
+          break;
+
+        inflight++;
+        s->state = sent;
+        transmit( *s, now );
+      }
+    };
+
+    void onframe( const ubxframe &frame ) override
+    {
+      if( frame.message != Message::ack && frame.message != Message::nak )
+        return;
+
+      ack reply( frame );  // ACK-NAK has the same layout
+
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        _ubxslot &s = slots[i];
+
+        if( s.state == sent && s.frame[2] == reply.getclsId() && s.frame[3] == reply.getmsgId() )
+        {
+          finish( s, frame.message == Message::ack ? Reply::ack : Reply::nak );
+          return;
+        }
+      }
+    };
+
+    // Commands queued or waiting for a reply, 0 once everything is done
+    uint8_t pending()
+    {
+      uint8_t n = 0;
+
+      for( uint8_t i = 0; i < Slots; i++ )
+        n += slots[i].state != empty;
+
+      return n;
+    };
+
+    uint32_t getacks()
+    {
+      return acks;
+    };
+
+    uint32_t getnaks()
+    {
+      return naks;
+    };
+
+    uint32_t gettimeouts()
+    {
+      return timeouts;
+    };
+
+  private:
+    enum : uint8_t { empty, queued, sent };
+
+    struct _ubxslot
+    {
+      const uint8_t *frame;
+      uint16_t length;
+      uint8_t state;
+      uint8_t tries;
+      uint32_t ticket;
+      uint32_t time;    // when it was last sent
+    };
+
+    _ubxslot *freeslot()
+    {
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        if( slots[i].state == empty )
+          return &slots[i];
+      }
+
+      return nullptr;
+    };
+
+    // the oldest command not sent yet that nothing in flight holds back
+    _ubxslot *next()
+    {
+      _ubxslot *oldest = nullptr;
+
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        _ubxslot &s = slots[i];
+
+        if( s.state == queued && ( oldest == nullptr || s.ticket < oldest->ticket ) && !waiting( s.frame[2], s.frame[3] ) )
+          oldest = &s;
+      }
+
+      return oldest;
+    };
+
+    bool waiting( uint8_t cl, uint8_t id )
+    {
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        if( slots[i].state == sent && slots[i].frame[2] == cl && slots[i].frame[3] == id )
+          return true;
+      }
+
+      return false;
+    };
+
+    void transmit( _ubxslot &s, uint32_t now )
+    {
+      sendPacket( s.frame, s.length );
+      s.tries++;
+      s.time = now;
+    };
+
+    void finish( _ubxslot &s, Reply reply )
+    {
+      s.state = empty;
+      inflight--;
+
+      if( reply == Reply::ack )
+        acks++;
+      else if( reply == Reply::nak )
+        naks++;
+      else
+        timeouts++;
+
+      if( callback )
+        callback( s.ticket, s.frame[2], s.frame[3], reply, context );
+    };
+
+    _ubxslot slots[Slots];
+    uint32_t tickets;
+    uint8_t inflight;
+    replycallback callback;
+    void *context;
+    uint32_t acks;
+    uint32_t naks;
+    uint32_t timeouts;
+};
+
+// *** Poll tracker
+// Once periodic messages are on the reply to a poll can turn up among
+// them at any time. The tracker remembers each poll until its reply comes
+// and hands the reply to whoever asked, once, or tells them it didn't come
+// by the deadline. A poll that is already waiting for its reply is not
+// sent again for a second requester, both get the one reply.
+//
+//   void ontp5( cfgtp5 *tp5, void *context ) { if( tp5 ) ... }
+//   ubxpolls<> polls;
+//   gps.attach( polls );
+//   polls.poll( ontp5, millis() );  // polls CFG-TP5
+//   ...
+//   polls.update( millis() );
+//
+// A reply matches a poll if it has the same class and id and its payload
+// starts with the poll's payload (the port of a CFG-PRT poll, the message
+// of a CFG-MSG poll). The reply must be a packet the parser knows. A
+// handler that takes a const ubxframe * gets the reply as it came.
+
+#ifndef UBXPOLLTIMEOUT
+#define UBXPOLLTIMEOUT 3000 // ms to wait for a reply
+#endif
+
+#ifndef UBXPOLLRESEND
+#define UBXPOLLRESEND 1000  // ms before a poll that may have been lost goes again
+#endif
+
+template<uint8_t Slots = 8>
+class ubxpolls : public ubxlistener
+{
+  public:
+    ubxpolls()
+    {
+      memset( slots, 0, sizeof( slots ) );
+      sent = 0;
+      shared = 0;
+      expired = 0;
+    };
+
+    // Polls the packet the handler takes. The handler gets the reply, or
+    // nullptr if there wasn't one in time.
+    template<class T>
+    bool poll( void (*handler)( T *packet, void *context ), uint32_t now, void *ctx = nullptr, uint32_t timeout = UBXPOLLTIMEOUT )
+    {
+      typedef ubxcommand<T::hdr::cl, T::hdr::id> request;
+
+      return poll( request::data, sizeof( request::data ), handler, now, ctx, timeout );
+    };
+
+    // The same with a poll that has a payload. The frame is not copied.
+    template<class T>
+    bool poll( const uint8_t *frame, uint16_t length, void (*handler)( T *packet, void *context ), uint32_t now, void *ctx = nullptr, uint32_t timeout = UBXPOLLTIMEOUT )
+    {
+      _ubxpoll *p = nullptr;
+      _ubxpoll *same = nullptr;
+
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        if( slots[i].frame == nullptr )
+          p = p ? p : &slots[i];
+        else if( slots[i].length == length && memcmp( slots[i].frame, frame, length ) == 0 )
+          same = &slots[i];
+      }
+
+      if( p == nullptr )
+        return false;
+
+      p->frame = frame;
+      p->length = length;
+      p->thunk = &ubxpolls::call<T>;
+      p->fn = (_ubxfn)handler;
+      p->context = ctx;
+      p->deadline = now + timeout;
+
+      if( same )
+      {
+        p->sent = same->sent;  // it is on its way already
+        shared++;
+      }
+      else
+        transmit( *p, now );
+
+      return true;
+    };
+
+    void update( uint32_t now )
+    {
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        _ubxpoll &p = slots[i];
+
+        if( p.frame == nullptr )
+          continue;
+
+        if( (int32_t)( now - p.deadline ) >= 0 )
+        {
+          expired++;
+          finish( p, nullptr );
+        }
+        else if( now - p.sent >= UBXPOLLRESEND )
+          resend( p, now );
+      }
+    };
+
+    void onframe( const ubxframe &frame ) override
+    {
+      uint16_t payload = frame.length - sizeof( _header );
+
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        _ubxpoll &p = slots[i];
+
+        if( p.frame == nullptr || p.frame[2] != frame.data[0] || p.frame[3] != frame.data[1] )
+          continue;
+
+        uint16_t selector = p.length - 2 - sizeof( _header ) - 2;
+
+        if( selector <= payload && memcmp( &p.frame[2 + sizeof( _header )], &frame.data[sizeof( _header )], selector ) == 0 )
+          finish( p, &frame );
+      }
+    };
+
+    // Polls waiting for a reply
+    uint8_t pending()
+    {
+      uint8_t n = 0;
+
+      for( uint8_t i = 0; i < Slots; i++ )
+        n += slots[i].frame != nullptr;
+
+      return n;
+    };
+
+    // Polls sent (resends included), polls that didn't need sending
+    // because the same one was waiting, and polls that got no reply
+    uint32_t getsent()
+    {
+      return sent;
+    };
+
+    uint32_t getshared()
+    {
+      return shared;
+    };
+
+    uint32_t getexpired()
+    {
+      return expired;
+    };
+
+  private:
+    struct _ubxpoll
+    {
+      const uint8_t *frame;   // nullptr for a free slot
+      uint16_t length;
+      void (*thunk)( const ubxframe *frame, _ubxfn fn, void *context );
+      _ubxfn fn;
+      void *context;
+      uint32_t sent;
+      uint32_t deadline;
+    };
+
+    template<class T>
+    static void call( const ubxframe *frame, _ubxfn fn, void *ctx )
+    {
+      if( frame )
+      {
+        T view( *frame );
+        ( (void (*)( T *, void * ))fn )( &view, ctx );
+      }
+      else
+        ( (void (*)( T *, void * ))fn )( nullptr, ctx );
+    };
+
+    void transmit( _ubxpoll &p, uint32_t now )
+    {
+      sendPacket( p.frame, p.length );
+      p.sent = now;
+      sent++;
+    };
+
+    // send again, once for everyone waiting for the same reply
+    void resend( _ubxpoll &p, uint32_t now )
+    {
+      transmit( p, now );
+
+      for( uint8_t i = 0; i < Slots; i++ )
+      {
+        if( slots[i].frame && slots[i].length == p.length && memcmp( slots[i].frame, p.frame, p.length ) == 0 )
+          slots[i].sent = now;
+      }
+    };
+
+    // The slot is free before the handler runs so it can poll again
+    void finish( _ubxpoll &p, const ubxframe *frame )
+    {
+      _ubxpoll done = p;
+
+      p.frame = nullptr;
+      done.thunk( frame, done.fn, done.context );
+    };
+
+    _ubxpoll slots[Slots];
+    uint32_t sent;
+    uint32_t shared;
+    uint32_t expired;
+};
+
+// *** Configuration cache
+// Brings the receiver to a configuration declared up front and only sends
+// the parts that differ. Each setting polls the receiver's current CFG
+// packet once per apply(), changes a copy of the reply and compares it
+// with the original. Only copies that changed are kept in the cache and
+// queued on the command queue, so a receiver that already has the
+// configuration (kept in battery backed RAM or flash) gets nothing but
+// the polls.
+//
+//   void slowpulse( cfgtp5 &tp5, void *context ) { tp5.setPulseLenRatio( 500000 ); }
+//   ubxconfig<> config( polls, commands );
+//   config.message( 0x01, 0x07, 1 );    // NAV-PVT every solution
+//   config.change<cfgtp5>( slowpulse );
+//   config.apply();
+//   ...
+//   config.update( millis() );          // along with polls and commands
+//
+// All the changes to the same packet are made to one copy. A setting
+// whose poll gets no reply fails, except that message() then sends its
+// rate for the port we are on anyway.
+
+#ifndef UBXPORT
+#define UBXPORT 1           // the receiver port we are connected to, 1 = UART1
+#endif
+
+template<uint8_t Settings = 16, uint16_t Cache = 256, class Polls = ubxpolls<>, class Commands = ubxcommands<>>
+class ubxconfig
+{
+  public:
+    ubxconfig( Polls &p, Commands &c ) : polls( p ), commands( c )
+    {
+      memset( settings, 0, sizeof( settings ) );
+      count = 0;
+      used = 0;
+      changed = 0;
+      unchanged = 0;
+      failed = 0;
+    };
+
+    // The rate a message comes out of our port at, 0 for off
+    bool message( uint8_t cl, uint8_t id, uint8_t rate )
+    {
+      const uint8_t selector[] = { cl, id };
+      _ubxsetting *s = add( _cfgmsghdr::cl, _cfgmsghdr::id, selector, sizeof( selector ) );
+
+      if( s == nullptr )
+        return false;
+
+      s->thunk = &ubxconfig::setrate;
+      s->rate = rate;
+      return true;
+    };
+
+    // Any change to a CFG packet the parser knows, made with its accessor
+    template<class T>
+    bool change( void (*fn)( T &packet, void *context ), void *ctx = nullptr )
+    {
+      _ubxsetting *s = add( T::hdr::cl, T::hdr::id, nullptr, 0 );
+
+      if( s == nullptr )
+        return false;
+
+      s->thunk = &ubxconfig::call<T>;
+      s->fn = (_ubxfn)fn;
+      s->context = ctx;
+      return true;
+    };
+
+    // Polls and compares everything again. The cache starts empty so
+    // nothing from an earlier apply() may still be on the command queue.
+    void apply()
+    {
+      used = 0;
+
+      for( uint8_t i = 0; i < count; i++ )
+        settings[i].state = wanted;
+    };
 
-  sendPacket(packet, sizeof(packet));
+    // Sends the polls the poll tracker has room for
+    void update( uint32_t now )
+    {
+      for( uint8_t i = 0; i < count; i++ )
+      {
+        _ubxsetting &s = settings[i];
+
+        if( s.state != wanted )
+          continue;
+
+        if( !polls.poll( s.poll, s.length, &ubxconfig::onreply, now, &s ) )
+          break;
+
+        s.state = polling;
+      }
+    };
+
+    // True once every setting has been compared and what differed is on
+    // the command queue
+    bool isdone()
+    {
+      for( uint8_t i = 0; i < count; i++ )
+      {
+        if( settings[i].state == wanted || settings[i].state == polling )
+          return false;
+      }
+
+      return true;
+    };
+
+    // Frames queued because something differed, packets that were already
+    // right, and settings that couldn't be checked or sent
+    uint32_t getchanged()
+    {
+      return changed;
+    };
+
+    uint32_t getunchanged()
+    {
+      return unchanged;
+    };
+
+    uint32_t getfailed()
+    {
+      return failed;
+    };
+
+  private:
+    enum : uint8_t { idle, wanted, polling, done };
+
+    struct _ubxsetting
+    {
+      uint8_t poll[2 + sizeof( _header ) + 2 + 2];  // with room for a CFG-MSG selector
+      uint8_t length;
+      void (*thunk)( uint8_t *data, _ubxsetting &s );
+      _ubxfn fn;
+      void *context;
+      uint8_t rate;
+      uint8_t state;
+      ubxconfig *config;
+    };
+
+    _ubxsetting *add( uint8_t cl, uint8_t id, const uint8_t *selector, uint8_t n )
+    {
+      if( count == Settings )
+        return nullptr;
+
+      _ubxsetting &s = settings[count++];
+      uint8_t *f = s.poll;
+
+      f[0] = 0xB5;
+      f[1] = 0x62;
+      f[2] = cl;
+      f[3] = id;
+      f[4] = n;
+      f[5] = 0;
+      if( n )
+        memcpy( &f[6], selector, n );
+
+      ubxchecksum( &f[6 + n], &f[2], sizeof( _header ) + n );
+
+      s.length = 2 + sizeof( _header ) + n + 2;
+      s.config = this;
+      return &s;
+    };
+
+    bool same( const _ubxsetting &a, const _ubxsetting &b )
+    {
+      return a.length == b.length && memcmp( a.poll, b.poll, a.length ) == 0;
+    };
+
+    template<class T>
+    static void call( uint8_t *data, _ubxsetting &s )
+    {
+      ubxframe frame = { T::hdr::message, data, (uint16_t)( sizeof( _header ) + ubxheader( data ).length ) };
+      T view( frame );
+
+      ( (void (*)( T &, void * ))s.fn )( view, s.context );
+    };
+
+    static void setrate( uint8_t *data, _ubxsetting &s )
+    {
+      data[offsetof( _cfgmsg, rate ) + UBXPORT] = s.rate;
+    };
+
+    static void onreply( const ubxframe *frame, void *ctx )
+    {
+      _ubxsetting &s = *(_ubxsetting *)ctx;
+
+      if( s.state == polling )
+        s.config->reply( s, frame );
+    };
+
+    // Every setting waiting for this packet changes the one copy
+    void reply( _ubxsetting &s, const ubxframe *frame )
+    {
+      if( frame == nullptr )
+      {
+        for( uint8_t i = 0; i < count; i++ )
+        {
+          if( settings[i].state == polling && same( settings[i], s ) )
+          {
+            settings[i].state = done;
+
+            if( settings[i].thunk != &ubxconfig::setrate || !fallback( settings[i] ) )
+              failed++;
+          }
+        }
+
+        return;
+      }
+
+      uint16_t n = 2 + frame->length + 2;
+      uint8_t *copy = &cache[used];
+
+      if( used + n > Cache )
+        copy = nullptr;
+      else
+        memcpy( &copy[2], frame->data, frame->length );
+
+      for( uint8_t i = 0; i < count; i++ )
+      {
+        if( settings[i].state == polling && same( settings[i], s ) )
+        {
+          settings[i].state = done;
+
+          if( copy )
+            settings[i].thunk( &copy[2], settings[i] );
+          else
+            failed++;
+        }
+      }
+
+      if( copy == nullptr )
+        return;
+
+      if( memcmp( &copy[2], frame->data, frame->length ) == 0 )
+      {
+        unchanged++;
+        return;
+      }
+
+      if( !send( copy, n ) )
+        failed++;
+    };
+
+    // The 3 byte CFG-MSG sets the rate on the port it comes in on
+    bool fallback( _ubxsetting &s )
+    {
+      const uint8_t payload[] = { s.poll[6], s.poll[7], s.rate };
+      uint16_t n = 2 + sizeof( _header ) + sizeof( payload ) + 2;
+      uint8_t *f = &cache[used];
+
+      if( used + n > Cache )
+        return false;
+
+      memcpy( &f[2], &s.poll[2], sizeof( _header ) );
+      f[4] = sizeof( payload );
+      memcpy( &f[6], payload, sizeof( payload ) );
+      return send( f, n );
+    };
+
+    bool send( uint8_t *f, uint16_t n )
+    {
+      f[0] = 0xB5;
+      f[1] = 0x62;
+      ubxchecksum( &f[n - 2], &f[2], n - 4 );
+
+      if( commands.add( f, n ) == 0 )
+        return false;
+
+      used += n;
+      changed++;
+      return true;
+    };
+
+    Polls &polls;
+    Commands &commands;
+    _ubxsetting settings[Settings];
+    uint8_t count;
+    uint8_t cache[Cache];
+    uint16_t used;
+    uint32_t changed;
+    uint32_t unchanged;
+    uint32_t failed;
+};
+
+// *** ublox configuration stuff
+// This depends on sendPacket() being defined in the main program
+
+// Print the packet specified to the PC  in a hexadecimal form, for debugging
+inline void printPacket(const byte *packet, uint16_t len)
+{
+    char temp[3];
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        sprintf(temp, "%.2X", packet[i]);
+        Serial.print(temp);
+
+        if (i != len - 1)
+        {
+            Serial.print(' ');
+        }
+    }
+
+    Serial.println();
 }
 
-void sendTimePulseParameters( uint32_t flags )
+// The constant commands have names so they can also be given to a
+// ubxcommands queue, e.g. commands.add<cfgnavpvton>()
+
+// CFG-CFG packet to restore default configuration
+typedef ubxcommand<0x06, 0x09,
+    0xFF, 0xFF, 0x00, 0x00, // clearMask
+    0x00, 0x00, 0x00, 0x00, // saveMask
+    0xFF, 0xFF, 0x00, 0x00, // loadMask
+    0x17                    // deviceMask
+> cfgdefaults;
+
+// Send a packet to the receiver to restore default configuration
+inline void restoreDefaults()
 {
-  byte packet[sizeof(_cfgtp5) + 4];
+    cfgdefaults::send();
+}
 
+// CFG-MSG packet turning one NMEA message off on every port
+template<uint8_t Cl, uint8_t Id>
+using _nmeaoff = ubxcommand<0x06, 0x01, Cl, Id, 0x00>;
+
+// All 20 CFG-MSG packets to turn NMEA off
+typedef ubxbatch<
+    _nmeaoff<0xF0, 0x0A>, _nmeaoff<0xF0, 0x09>, _nmeaoff<0xF0, 0x00>, _nmeaoff<0xF0, 0x01>,
+    _nmeaoff<0xF0, 0x0D>, _nmeaoff<0xF0, 0x06>, _nmeaoff<0xF0, 0x02>, _nmeaoff<0xF0, 0x07>,
+    _nmeaoff<0xF0, 0x03>, _nmeaoff<0xF0, 0x04>, _nmeaoff<0xF0, 0x0E>, _nmeaoff<0xF0, 0x0F>,
+    _nmeaoff<0xF0, 0x05>, _nmeaoff<0xF0, 0x08>, _nmeaoff<0xF1, 0x00>, _nmeaoff<0xF1, 0x01>,
+    _nmeaoff<0xF1, 0x03>, _nmeaoff<0xF1, 0x04>, _nmeaoff<0xF1, 0x05>, _nmeaoff<0xF1, 0x06>
+> cfgnmeaoff;
+
+// Send a set of packets to the receiver to disable NMEA messages, not
+// needed if the input goes through a ubxdemux
+inline void disableNmea()
+{
+    cfgnmeaoff::send();  // all 20 go in one write
+}
 
-  packet[0] =  0xB5; // sync char 1
-  packet[1] =  0x62; // sync char 2
-  packet[2] =  cfgtp5hdr.cl;
-  packet[3] =  cfgtp5hdr.id;
-  uint16_t *i16p = (uint16_t *)&(packet[4]);
-  *i16p = cfgtp5hdr.length;
+// Send a packet to the receiver to change baudrate (in bits/second)
+inline void changeBaudrate( uint32_t baudRate )
+{
+    // CFG-PRT packet for UART1, 8N1, UBX, NMEA and RTCM2 in, UBX and NMEA out
+    ubxpatch< ubxcommand<0x06, 0x00,
+        0x01, 0x00, 0x00, 0x00, // portID, reserved, txReady
+        0xD0, 0x08, 0x00, 0x00, // mode
+        0x00, 0xC2, 0x01, 0x00, // baudRate
+        0x07, 0x00, 0x03, 0x00, // inProtoMask, outProtoMask
+        0x00, 0x00, 0x00, 0x00  // flags, reserved
+    > > packet;
+
+    packet.set( 8, baudRate );
+    packet.send();
+}
 
-  _cfgtp5 *p = (_cfgtp5 *)&(packet[2]);
+// Send a packet to the receiver to change nav period to requested ms (1000 = 1 Hz)
+inline void changeFrequency( uint16_t ms )
+{
+    // CFG-RATE packet
+    ubxpatch< ubxcommand<0x06, 0x08,
+        0x64, 0x00, // measRate
+        0x01, 0x00, // navRate
+        0x01, 0x00  // timeRef
+    > > packet;
+
+    packet.set( 0, ms );
+    packet.send();
+}
 
-  p->tpIdx = 0;    // 0 = TIMEPULSE, 1 = TIMEPULSE2
-  p->version = 0;  // 1 for this version
-  p->reserved = 0;
-  p->antCableDelay = 50;  // antenna cable delay in ns
-  p->rfGroupDelay = 0;   // RF group delay in ns
-  p->freqPeriod = 1000000;     // frequency in Hz or period in us
-  p->freqPeriodLock = 1000000; // frequency or period when locked
-  p->pulseLenRatio = 500000;  // pulse length or duty cycle
-  p->pulseLenRatioLock = 100000;  // pulse length or duty cycle when locked
-  p->userConfigDelay = 0;    // user configurable time pulse delay in ns
-  p->flags = flags;
+// Send a packet to the receiver to change dynamic model
+inline void changeDynamicModel( uint8_t model )
+{
+    // CFG-NAV5 packet, only the dynamic model is applied
+    ubxpatch< ubxcommand<0x06, 0x24,
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // mask, dynModel
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00
+    > > packet;
+
+    packet.set( 2, model );
+    packet.send();
+}
 
-  byte packetSize = sizeof(packet);
+// CFG-GNSS packet
+typedef ubxcommand<0x06, 0x3E,
+    0x00, 0x00, 0x16, 0x04, 0x00, 0x04, 0xFF, 0x00,
+    0x01, 0x00, 0x00, 0x01, 0x01, 0x01, 0x03, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x05, 0x00, 0x03, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x06, 0x08, 0xFF, 0x00,
+    0x00, 0x00, 0x00, 0x01
+> cfgchannels;
 
-  packet[packetSize - 1] = 0;
-  packet[packetSize - 2] = 0;
+// Send a packet to the receiver to disable unnecessary channels
+inline void disableUnnecessaryChannels()
+{
+    cfgchannels::send();
+}
 
-  for (byte j = 0; j < packetSize - 4; j++)
-  {
-      packet[packetSize - 2] += packet[2 + j];
-      packet[packetSize - 1] += packet[packetSize - 2];
-  }
+// CFG-MSG packets
+typedef ubxcommand<0x06, 0x01, _navpvt8hdr::cl, _navpvt8hdr::id, 0x01> cfgnavpvton;
+typedef ubxcommand<0x06, 0x01, _navsathdr::cl, _navsathdr::id, 0x01> cfgnavsaton;
 
-  sendPacket(packet, sizeof(packet));
+// Send a packet to the receiver to enable NAV-PVT messages
+inline void enableNavPvt()
+{
+    cfgnavpvton::send();
 }
 
-void pollSatNavParameters()
+// Send a packet to the receiver to enable NAV-SAT messages
+inline void enableNavSat()
 {
-  byte packet[] =
-  {
-      0xB5, // sync char 1
-      0x62, // sync char 2
-      0x01, // class
-      0x35, // id
-      0x00, // length
-      0x00, // length
-      0x00, // CK_A
-      0x00, // CK_B
-  };
+    cfgnavsaton::send();
+}
 
-  byte packetSize = sizeof(packet);
+typedef ubxcommand<0x06, 0x01, _naveoehdr::cl, _naveoehdr::id, 0x01> cfgnaveoeon;
+typedef ubxcommand<0x06, 0x01, _rxmrawxhdr::cl, _rxmrawxhdr::id, 0x01> cfgrawxon;
+typedef ubxcommand<0x06, 0x01, _rxmsfrbxhdr::cl, _rxmsfrbxhdr::id, 0x01> cfgsfrbxon;
 
-  for (byte j = 0; j < packetSize - 4; j++)
-  {
-      packet[packetSize - 2] += packet[2 + j];
-      packet[packetSize - 1] += packet[packetSize - 2];
-  }
+// Send a packet to the receiver to enable NAV-EOE messages
+inline void enableNavEoe()
+{
+    cfgnaveoeon::send();
+}
+
+// Send a packet to the receiver to enable RXM-RAWX messages (M8T only)
+inline void enableRxmRawx()
+{
+    cfgrawxon::send();
+}
+
+// Send a packet to the receiver to enable RXM-SFRBX messages
+inline void enableRxmSfrbx()
+{
+    cfgsfrbxon::send();
+}
+
+inline void pollTimePulseParameters()
+{
+  ubxcommand<_cfgtp5hdr::cl, _cfgtp5hdr::id>::send();
+}
+
+inline void sendTimePulseParameters( uint32_t flags )
+{
+  // CFG-TP5 packet, only the flags change
+  ubxpatch< ubxcommand<_cfgtp5hdr::cl, _cfgtp5hdr::id,
+      0x00,                   // tpIdx, 0 = TIMEPULSE, 1 = TIMEPULSE2
+      0x00,                   // version
+      0x00, 0x00,             // reserved
+      0x32, 0x00,             // antCableDelay, 50ns
+      0x00, 0x00,             // rfGroupDelay
+      0x40, 0x42, 0x0F, 0x00, // freqPeriod, 1000000us
+      0x40, 0x42, 0x0F, 0x00, // freqPeriodLock
+      0x20, 0xA1, 0x07, 0x00, // pulseLenRatio, 500000us
+      0xA0, 0x86, 0x01, 0x00, // pulseLenRatioLock, 100000us
+      0x00, 0x00, 0x00, 0x00, // userConfigDelay
+      0x00, 0x00, 0x00, 0x00  // flags
+  > > packet;
+
+  packet.set( 28, flags );
+  packet.send();
+}
 
-  sendPacket(packet, sizeof(packet));
+inline void pollSatNavParameters()
+{
+  ubxcommand<_navsathdr::cl, _navsathdr::id>::send();
 }
 
+// *** Baud rate negotiation
+// Finds the rate the receiver is at and moves it to the one we want,
+// without blocking. Each candidate rate is tried in turn (the target
+// first, so a warm restart is done after one poll): our port is set to it,
+// CFG-PRT is polled and if a good UBX or NMEA frame comes back within
+// UBXBAUDLISTEN ms that is the receiver's rate. If it isn't the target the
+// receiver's own answer to the poll goes back to it with only the rate
+// changed, so the port's mode and protocols stay as they are. Our port
+// follows and one more poll confirms it. If that fails the search starts
+// again.
+//
+//   void setbaud( uint32_t baud, void * ) { gpsSerial.updateBaudRate( baud ); }
+//   ubxbaud baud( 115200, setbaud );
+//   ...
+//   baud.feed( chunk, n );          // every chunk read while !baud.isdone()
+//   baud.update( millis() );
+
+#ifndef UBXBAUDLISTEN
+#define UBXBAUDLISTEN 200   // ms to wait for a frame after a poll
+#endif
+
+#ifndef UBXBAUDSETTLE
+#define UBXBAUDSETTLE 50    // ms for CFG-PRT to go out before our rate changes
+#endif
+
+// Sets the rate of our serial port
+typedef void (*baudcallback)( uint32_t baud, void *context );
+
+// probe sets our port to the next rate and polls, listen waits for an
+// answer, settle lets CFG-PRT go out, confirm polls at the new rate
+enum class Baud : uint8_t { probe, listen, settle, confirm, done };
+
+class ubxbaud
+{
+  public:
+    ubxbaud( uint32_t target, baudcallback setbaud, void *ctx = nullptr )
+    {
+      this->target = target;
+      callback = setbaud;
+      context = ctx;
+      stage = Baud::probe;
+      candidate = 0;
+      baud = 0;
+      heard = false;
+      prt = false;
+      detect = idle;
+      rounds = 0;
+    };
+
+    // Bytes from the receiver, only needed until done()
+    void feed( const uint8_t *data, size_t len )
+    {
+      if( stage != Baud::listen && stage != Baud::confirm )
+        return;
+
+      for( size_t i = 0; i < len && !prt; i++ )
+        heard |= check( data[i] );
+    };
+
+    // Returns true once the receiver and our port are both at the target
+    bool update( uint32_t now )
+    {
+      switch( stage )
+      {
+        case Baud::probe:
+          baud = candidate == 0 ? target : rate( candidate - 1 );
+          callback( baud, context );
+          poll( now );
+          stage = Baud::listen;
+          break;
+
+        case Baud::listen:
+          if( heard && baud == target )
+            stage = Baud::done;
+          else if( prt )
+          {
+            // the rate is all that changes, read-modify-write
+            UBXSET( reply, _cfgprt, baudRate, target );
+            ubxsend( reply, sizeof( reply ) );
+            time = now;
+            stage = Baud::settle;
+          }
+          else if( now - time >= UBXBAUDLISTEN )
+            nextcandidate();
+          break;
+
+        case Baud::settle:
+          if( now - time >= UBXBAUDSETTLE )
+          {
+            baud = target;
+            callback( baud, context );
+            poll( now );
+            stage = Baud::confirm;
+          }
+          break;
+
+        case Baud::confirm:
+          if( heard )
+            stage = Baud::done;
+          else if( now - time >= UBXBAUDLISTEN )
+            nextcandidate();
+          break;
+
+        case Baud::done:
+          break;
+      }
+
+      return stage == Baud::done;
+    };
+
+    bool isdone()
+    {
+      return stage == Baud::done;
+    };
+
+    Baud getstage()
+    {
+      return stage;
+    };
+
+    // The rate being tried, or the receiver's rate once done
+    uint32_t getbaud()
+    {
+      return baud;
+    };
+
+    // How many times every rate has been tried without success
+    uint8_t getrounds()
+    {
+      return rounds;
+    };
+
+  private:
+    static constexpr uint8_t ratecount = 8;
+
+    // the rates to try, most likely first, in a function so the header
+    // can go in more than one source file
+    static uint32_t rate( uint8_t i )
+    {
+      static const uint32_t rates[ratecount] = { 9600, 115200, 38400, 57600, 19200, 230400, 460800, 4800 };
+
+      return rates[i];
+    };
+
+    void poll( uint32_t now )
+    {
+      heard = false;
+      prt = false;
+      detect = idle;
+      time = now;
+      ubxcommand<0x06, 0x00>::send();  // CFG-PRT for the port we are on
+    };
+
+    void nextcandidate()
+    {
+      do
+      {
+        if( ++candidate > ratecount )
+        {
+          candidate = 0;
+          rounds++;
+        }
+      }
+      while( candidate != 0 && rate( candidate - 1 ) == target );
+
+      stage = Baud::probe;
+    };
+
+    // Just enough of a parser to tell a good frame from line noise at the
+    // wrong rate, true when a UBX or NMEA frame checks out
+    bool check( uint8_t c )
+    {
+      switch( detect )
+      {
+        case idle:
+          break;
+
+        case sync2:
+          if( c == 0x62 )
+          {
+            ck[0] = ck[1] = 0;
+            count = 0;
+            detect = header;
+            return false;
+          }
+          break;
+
+        case header:
+          sum( c );
+          reply[count] = c;
+          length = count == 2 ? c : count == 3 ? length | c << 8 : length;
+
+          if( ++count == 4 )
+            detect = length > MAXBUFFERSIZE ? idle : length ? payload : check1;
+          return false;
+
+        case payload:
+          sum( c );
+
+          if( count < sizeof( reply ) )
+            reply[count++] = c;
+
+          if( --length == 0 )
+            detect = check1;
+          return false;
+
+        case check1:
+          detect = c == ck[0] ? check2 : idle;
+          return false;
+
+        case check2:
+          detect = idle;
+
+          if( c != ck[1] )
+            break;
+
+          // the answer to the poll, kept for changing the rate
+          prt = reply[0] == _cfgprthdr::cl && reply[1] == _cfgprthdr::id && count == sizeof( reply ) &&
+                UBXGET( reply, _header, length ) == _cfgprthdr::length;
+          return true;
+
+        case sentence:
+          if( c == '*' )
+          {
+            detect = hex1;
+            return false;
+          }
+
+          if( c >= 0x20 && c <= 0x7E && c != '$' && ++count < UBXNMEAMAX )
+          {
+            ck[0] ^= c;
+            return false;
+          }
+          break;
+
+        case hex1:
+          if( hexdigit( c ) == ( ck[0] >> 4 ) )
+          {
+            detect = hex2;
+            return false;
+          }
+          break;
+
+        case hex2:
+          detect = idle;
+          return hexdigit( c ) == ( ck[0] & 15 );
+      }
+
+      // anything that doesn't fit may be the start of the next frame
+      if( c == 0xB5 )
+        detect = sync2;
+      else if( c == '$' )
+      {
+        ck[0] = 0;
+        count = 0;
+        detect = sentence;
+      }
+      else
+        detect = idle;
+
+      return false;
+    };
+
+    void sum( uint8_t c )
+    {
+      ck[0] += c;
+      ck[1] += ck[0];
+    };
+
+    static int hexdigit( uint8_t c )
+    {
+      return c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    };
+
+    enum : uint8_t { idle, sync2, header, payload, check1, check2, sentence, hex1, hex2 };
+
+    uint32_t target;
+    baudcallback callback;
+    void *context;
+    Baud stage;
+    uint8_t candidate;  // 0 is the target, then rate( candidate - 1 )
+    uint32_t baud;
+    uint32_t time;
+    bool heard;
+    bool prt;           // reply holds the receiver's CFG-PRT
+    uint8_t reply[sizeof( _header ) + _cfgprthdr::length];
+    uint8_t rounds;
+    uint8_t detect;
+    uint8_t ck[2];
+    uint16_t count;
+    uint16_t length;
+};
+
 #endif
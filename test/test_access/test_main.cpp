@@ -0,0 +1,352 @@
+/*
+  Accessors against the field offsets in the u-blox 8 protocol spec, with
+  every packet at an odd address, and what an accessor costs next to
+  laying the struct over the buffer
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+// Little endian, whatever the host
+template<typename T>
+static void put( std::vector<uint8_t> &payload, size_t offset, T value )
+{
+  uint64_t v;
+
+  memcpy( &v, &value, sizeof( T ) < sizeof( v ) ? sizeof( T ) : sizeof( v ) );
+  for( size_t i = 0; i < sizeof( T ); i++ )
+    payload[offset + i] = (uint8_t)( v >> ( 8 * i ) );
+}
+
+// The packet one byte into a buffer so no field is aligned
+static std::vector<uint8_t> store;
+
+static ubxframe view( Message message, uint8_t cl, uint8_t id, const std::vector<uint8_t> &payload )
+{
+  store.assign( 1 + sizeof( _header ), 0 );
+  store[1] = cl;
+  store[2] = id;
+  store[3] = (uint8_t)payload.size();
+  store[4] = (uint8_t)( payload.size() >> 8 );
+  store.insert( store.end(), payload.begin(), payload.end() );
+
+  ubxframe frame = { message, &store[1], (uint16_t)( sizeof( _header ) + payload.size() ) };
+  return frame;
+}
+
+void test_navpvt()
+{
+  std::vector<uint8_t> p( 92, 0 );
+
+  put<uint16_t>( p, 4, 2019 );
+  put<uint8_t>( p, 6, 2 );
+  put<uint8_t>( p, 7, 11 );
+  put<uint8_t>( p, 8, 13 );
+  put<uint8_t>( p, 9, 14 );
+  put<uint8_t>( p, 10, 15 );
+  put<uint8_t>( p, 11, 0x07 );
+  put<uint32_t>( p, 12, 21 );
+  put<int32_t>( p, 16, -123456 );
+  put<uint8_t>( p, 21, 0x01 );
+  put<uint8_t>( p, 23, 17 );
+  put<int32_t>( p, 24, -1234567891 );
+  put<int32_t>( p, 28, 512345678 );
+  put<int32_t>( p, 32, -4567 );
+  put<uint32_t>( p, 40, 3456 );
+  put<uint32_t>( p, 44, 5678 );
+  put<int32_t>( p, 60, 2500 );
+  put<int32_t>( p, 64, 27000000 );
+  put<uint16_t>( p, 76, 123 );
+
+  navpvt8 nav( view( Message::navpvt8, 0x01, 0x07, p ) );
+
+  TEST_ASSERT_EQUAL( 2019, nav.getyear() );
+  TEST_ASSERT_EQUAL( 2, nav.getmonth() );
+  TEST_ASSERT_EQUAL( 11, nav.getday() );
+  TEST_ASSERT_EQUAL( 13, nav.gethour() );
+  TEST_ASSERT_EQUAL( 14, nav.getminute() );
+  TEST_ASSERT_EQUAL( 15, nav.getsecond() );
+  TEST_ASSERT_EQUAL( 0x07, nav.getvalid() );
+  TEST_ASSERT_EQUAL( 21, nav.gettacc() );
+  TEST_ASSERT_EQUAL( -123456, nav.getnano() );
+  TEST_ASSERT_EQUAL( 0x01, nav.getflags() );
+  TEST_ASSERT_EQUAL( 17, nav.getnumSV() );
+  TEST_ASSERT_EQUAL( -1234567891, nav.getlon7() );
+  TEST_ASSERT_EQUAL( 512345678, nav.getlat7() );
+  TEST_ASSERT_EQUAL( -4567, nav.getheightmm() );
+  TEST_ASSERT_EQUAL( 3456, nav.gethAccmm() );
+  TEST_ASSERT_EQUAL( 5678, nav.getvAccmm() );
+  TEST_ASSERT_EQUAL( 2500, nav.getgSpeedmm() );
+  TEST_ASSERT_EQUAL( 27000000, nav.getheadMot5() );
+  TEST_ASSERT_EQUAL( 123, nav.getpDOP100() );
+  TEST_ASSERT_TRUE( nav.getlat() == 512345678 * en7 );
+}
+
+void test_cfgtp5()
+{
+  std::vector<uint8_t> p( 32, 0 );
+
+  put<int16_t>( p, 4, 50 );
+  put<int16_t>( p, 6, 0 );
+  put<uint32_t>( p, 8, 1000000 );
+  put<uint32_t>( p, 12, 2000000 );
+  put<uint32_t>( p, 16, 500000 );
+  put<uint32_t>( p, 20, 100000 );
+  put<int32_t>( p, 24, -20 );
+  put<uint32_t>( p, 28, 0xF7 );
+
+  cfgtp5 tp( view( Message::cfgtp5, 0x06, 0x31, p ) );
+
+  TEST_ASSERT_EQUAL( 50, tp.getAntCableDelay() );
+  TEST_ASSERT_EQUAL( 1000000, tp.getFreqPeriod() );
+  TEST_ASSERT_EQUAL( 2000000, tp.getFreqPeriodLock() );
+  TEST_ASSERT_EQUAL( 500000, tp.getPulseLenRatio() );
+  TEST_ASSERT_EQUAL( 100000, tp.getPulseLenRatioLock() );
+  TEST_ASSERT_EQUAL( -20, tp.getUserConfigDelay() );
+  TEST_ASSERT_EQUAL( 0xF7, tp.getFlags() );
+
+  // setters write the same places
+  tp.setPulseLenRatio( 0x12345678 );
+  tp.setFlags( 0x77 );
+  TEST_ASSERT_EQUAL( 0x78, store[1 + 4 + 16] );
+  TEST_ASSERT_EQUAL( 0x12, store[1 + 4 + 19] );
+  TEST_ASSERT_EQUAL( 0x77, store[1 + 4 + 28] );
+}
+
+void test_navsat()
+{
+  std::vector<uint8_t> p( 8 + 12 * 3, 0 );
+
+  put<uint8_t>( p, 5, 3 );
+  for( int i = 0; i < 3; i++ )
+  {
+    size_t b = 8 + 12 * i;
+
+    put<uint8_t>( p, b + 0, 6 );
+    put<uint8_t>( p, b + 1, 10 + i );
+    put<uint8_t>( p, b + 2, 40 + i );
+    put<int8_t>( p, b + 3, -5 );
+    put<int16_t>( p, b + 4, 300 + i );
+    put<int16_t>( p, b + 6, -1234 );
+    put<uint32_t>( p, b + 8, 0x00012345 + i );
+  }
+
+  navsat sat( view( Message::navsat, 0x01, 0x35, p ) );
+
+  TEST_ASSERT_EQUAL( 3, sat.getnumSvs() );
+  for( int i = 0; i < 3; i++ )
+  {
+    TEST_ASSERT_EQUAL( 6, sat.getgnssId( i ) );
+    TEST_ASSERT_EQUAL( 10 + i, sat.getsvId( i ) );
+    TEST_ASSERT_EQUAL( 40 + i, sat.getcno( i ) );
+    TEST_ASSERT_EQUAL( -5, sat.getelev( i ) );
+    TEST_ASSERT_EQUAL( 300 + i, sat.getazim( i ) );
+    TEST_ASSERT_EQUAL( -1234, sat.getprRes( i ) );
+    TEST_ASSERT_EQUAL( 0x00012345 + i, sat.getflags( i ) );
+  }
+}
+
+void test_cfg()
+{
+  std::vector<uint8_t> gnss( 4 + 8 * 2, 0 );
+
+  put<uint8_t>( gnss, 3, 2 );
+  put<uint8_t>( gnss, 4 + 8 + 0, 1 );
+  put<uint32_t>( gnss, 4 + 8 + 4, 0x01010001 );
+
+  cfggnss g( view( Message::cfggnss, 0x06, 0x3E, gnss ) );
+
+  TEST_ASSERT_EQUAL( 2, g.getnumConfigBlocks() );
+  TEST_ASSERT_EQUAL( 1, g.getgnssId( 1 ) );
+  TEST_ASSERT_EQUAL( 0x01010001, g.getFlags( 1 ) );
+
+  std::vector<uint8_t> prt( 20, 0 );
+
+  put<uint8_t>( prt, 0, 1 );
+  put<uint32_t>( prt, 4, 0x08D0 );
+  put<uint32_t>( prt, 8, 115200 );
+  put<uint16_t>( prt, 12, 0x0007 );
+  put<uint16_t>( prt, 14, 0x0001 );
+
+  cfgprt port( view( Message::cfgprt, 0x06, 0x00, prt ) );
+
+  TEST_ASSERT_EQUAL( 1, port.getPortId() );
+  TEST_ASSERT_EQUAL( 0x08D0, port.getMode() );
+  TEST_ASSERT_EQUAL( 115200, port.getBaudRate() );
+  TEST_ASSERT_EQUAL( 0x0007, port.getInProtoMask() );
+  TEST_ASSERT_EQUAL( 0x0001, port.getOutProtoMask() );
+
+  std::vector<uint8_t> msg = { 0x01, 0x07, 0, 1, 2, 3, 4, 5 };
+  cfgmsg m( view( Message::cfgmsg, 0x06, 0x01, msg ) );
+
+  TEST_ASSERT_EQUAL( 0x01, m.getMsgClass() );
+  TEST_ASSERT_EQUAL( 0x07, m.getMsgId() );
+  TEST_ASSERT_EQUAL( 3, m.getRate( 3 ) );
+
+  std::vector<uint8_t> nav5( 36, 0 );
+
+  put<uint8_t>( nav5, 2, 7 );
+  put<uint8_t>( nav5, 3, 2 );
+  put<int8_t>( nav5, 12, -3 );
+  put<uint8_t>( nav5, 30, 3 );
+
+  cfgnav5 n( view( Message::cfgnav5, 0x06, 0x24, nav5 ) );
+
+  TEST_ASSERT_EQUAL( 7, n.getDynModel() );
+  TEST_ASSERT_EQUAL( 2, n.getFixMode() );
+  TEST_ASSERT_EQUAL( -3, n.getMinElev() );
+  TEST_ASSERT_EQUAL( 3, n.getUtcStandard() );
+
+  std::vector<uint8_t> rate = { 0xC8, 0x00, 0x01, 0x00, 0x01, 0x00 };
+  cfgrate r( view( Message::cfgrate, 0x06, 0x08, rate ) );
+
+  TEST_ASSERT_EQUAL( 200, r.getMeasRate() );
+  TEST_ASSERT_EQUAL( 1, r.getNavRate() );
+  TEST_ASSERT_EQUAL( 1, r.getTimeRef() );
+}
+
+void test_rxm()
+{
+  std::vector<uint8_t> p( 16 + 32 * 2, 0 );
+
+  put<double>( p, 0, 123456.789 );
+  put<uint16_t>( p, 8, 2040 );
+  put<int8_t>( p, 10, 18 );
+  put<uint8_t>( p, 11, 2 );
+  put<uint8_t>( p, 12, 0x01 );
+  put<double>( p, 16 + 32 + 0, 23456789.125 );
+  put<double>( p, 16 + 32 + 8, -1234567.5 );
+  put<float>( p, 16 + 32 + 16, -1500.25f );
+  put<uint8_t>( p, 16 + 32 + 20, 2 );
+  put<uint8_t>( p, 16 + 32 + 21, 11 );
+  put<uint8_t>( p, 16 + 32 + 22, 1 );
+  put<uint16_t>( p, 16 + 32 + 24, 64500 );
+  put<uint8_t>( p, 16 + 32 + 26, 45 );
+  put<uint8_t>( p, 16 + 32 + 30, 0x0F );
+
+  rxmrawx raw( view( Message::rxmrawx, 0x02, 0x15, p ) );
+
+  TEST_ASSERT_TRUE( raw.getrcvTow() == 123456.789 );
+  TEST_ASSERT_EQUAL( 2040, raw.getweek() );
+  TEST_ASSERT_EQUAL( 18, raw.getleapS() );
+  TEST_ASSERT_EQUAL( 2, raw.getnumMeas() );
+  TEST_ASSERT_EQUAL( 0x01, raw.getrecStat() );
+  TEST_ASSERT_TRUE( raw.getprMes( 1 ) == 23456789.125 );
+  TEST_ASSERT_TRUE( raw.getcpMes( 1 ) == -1234567.5 );
+  TEST_ASSERT_TRUE( raw.getdoMes( 1 ) == -1500.25f );
+  TEST_ASSERT_EQUAL( 2, raw.getgnssId( 1 ) );
+  TEST_ASSERT_EQUAL( 11, raw.getsvId( 1 ) );
+  TEST_ASSERT_EQUAL( 1, raw.getsigId( 1 ) );
+  TEST_ASSERT_EQUAL( 64500, raw.getlocktime( 1 ) );
+  TEST_ASSERT_EQUAL( 45, raw.getcno( 1 ) );
+  TEST_ASSERT_EQUAL( 0x0F, raw.gettrkStat( 1 ) );
+
+  std::vector<uint8_t> s( 8 + 4 * 10, 0 );
+
+  put<uint8_t>( s, 0, 3 );
+  put<uint8_t>( s, 1, 24 );
+  put<uint8_t>( s, 3, 7 );
+  put<uint8_t>( s, 4, 10 );
+  put<uint8_t>( s, 5, 4 );
+  put<uint32_t>( s, 8 + 4 * 9, 0xDEADBEEF );
+
+  rxmsfrbx sfrbx( view( Message::rxmsfrbx, 0x02, 0x13, s ) );
+
+  TEST_ASSERT_EQUAL( 3, sfrbx.getgnssId() );
+  TEST_ASSERT_EQUAL( 24, sfrbx.getsvId() );
+  TEST_ASSERT_EQUAL( 7, sfrbx.getfreqId() );
+  TEST_ASSERT_EQUAL( 10, sfrbx.getnumWords() );
+  TEST_ASSERT_EQUAL( 4, sfrbx.getchn() );
+  TEST_ASSERT_EQUAL( 0xDEADBEEF, sfrbx.getdwrd( 9 ) );
+
+  std::vector<uint8_t> e( 4, 0 );
+
+  put<uint32_t>( e, 0, 345600000 );
+  naveoe eoe( view( Message::naveoe, 0x01, 0x61, e ) );
+
+  TEST_ASSERT_EQUAL( 345600000, eoe.getiTOW() );
+}
+
+static volatile int64_t sink;
+
+static const int packets = 64;
+static const int rounds = 2000;
+static _navpvt8 pvts[packets];
+
+static int64_t byaccessors()
+{
+  int64_t sum = 0;
+
+  for( int r = 0; r < rounds; r++ )
+    for( int i = 0; i < packets; i++ )
+    {
+      ubxframe frame = { Message::navpvt8, (uint8_t *)&pvts[i], sizeof( _navpvt8 ) };
+      navpvt8 nav( frame );
+
+      sum += nav.getlat7() + nav.getlon7() + nav.gethAccmm() + nav.getnumSV();
+    }
+
+  return sum;
+}
+
+static int64_t bycast()
+{
+  int64_t sum = 0;
+
+  for( int r = 0; r < rounds; r++ )
+    for( int i = 0; i < packets; i++ )
+    {
+      const _navpvt8 *nav = &pvts[i];
+
+      sum += nav->lat + nav->lon + nav->hAcc + nav->numSV;
+    }
+
+  return sum;
+}
+
+// A handful of NAV-PVT fields per packet, read through the accessors and
+// read the way the library used to, by casting the buffer to the struct.
+// The two take turns and the best of several runs is kept, so neither
+// pays for warming up the cache or the clock.
+void test_benchmark()
+{
+  uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+
+  for( int i = 0; i < packets; i++ )
+  {
+    pvts[i].lat = 512345678 + i;
+    pvts[i].lon = -1234567 * i;
+    pvts[i].hAcc = 1000 + i;
+    pvts[i].numSV = i;
+  }
+
+  for( int run = 0; run < 9; run++ )
+  {
+    uint64_t t0 = nanos();
+    int64_t a = byaccessors();
+    uint64_t t1 = nanos();
+    int64_t c = bycast();
+    uint64_t t2 = nanos();
+
+    TEST_ASSERT_TRUE( a == c );
+    sink = a;
+    best[0] = std::min( best[0], t1 - t0 );
+    best[1] = std::min( best[1], t2 - t1 );
+  }
+
+  report( "4 fields through the accessors", (double)best[0] / ( rounds * packets ) );
+  report( "4 fields through a struct cast", (double)best[1] / ( rounds * packets ) );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_navpvt );
+  RUN_TEST( test_cfgtp5 );
+  RUN_TEST( test_navsat );
+  RUN_TEST( test_cfg );
+  RUN_TEST( test_rxm );
+  RUN_TEST( test_benchmark );
+  return UNITY_END();
+}
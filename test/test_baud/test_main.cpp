@@ -0,0 +1,118 @@
+/*
+  Baud rate search and switch against a simulated receiver
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+// The receiver's CFG-PRT, on UART2 with UBX only in and out
+static uint8_t port[20];
+static uint32_t host;
+static std::vector<uint8_t> replies;
+
+static uint32_t getbaud()
+{
+  uint32_t b;
+
+  memcpy( &b, &port[8], 4 );
+  return b;
+}
+
+static void reset( uint32_t baud )
+{
+  const uint8_t p[20] = { 0x02, 0x00, 0x00, 0x00, 0xC0, 0x08, 0x00, 0x00, 0, 0, 0, 0, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+  memcpy( port, p, sizeof( port ) );
+  memcpy( &port[8], &baud, 4 );
+  sent.clear();
+  replies.clear();
+}
+
+// What the receiver makes of everything sent to it, at the wrong rate it
+// is garbage
+static void receiver()
+{
+  if( host == getbaud() )
+  {
+    for( size_t i = 0; i + 8 <= sent.size(); )
+    {
+      uint16_t len = sent[i + 4] | sent[i + 5] << 8;
+
+      if( sent[i + 2] == 0x06 && sent[i + 3] == 0x00 )
+      {
+        if( len == 0 )
+        {
+          std::vector<uint8_t> f = ubxframeof( 0x06, 0x00, std::vector<uint8_t>( port, port + sizeof( port ) ) );
+          replies.insert( replies.end(), f.begin(), f.end() );
+        }
+        else if( len == sizeof( port ) )
+          memcpy( port, &sent[i + 6], sizeof( port ) );
+      }
+
+      i += 6 + len + 2;
+    }
+  }
+
+  sent.clear();
+}
+
+static bool run( ubxbaud &baud )
+{
+  for( uint32_t now = 0; now < 20000; now += 5 )
+  {
+    if( baud.update( now ) )
+      return true;
+
+    receiver();
+    baud.feed( replies.data(), replies.size() );
+    replies.clear();
+  }
+
+  return false;
+}
+
+static void setbaud( uint32_t baud, void *context )
+{
+  host = baud;
+}
+
+void test_switch_keeps_port()
+{
+  uint32_t starts[] = { 9600, 38400, 4800, 460800 };
+
+  for( uint32_t start : starts )
+  {
+    ubxbaud baud( 115200, setbaud );
+
+    reset( start );
+    TEST_ASSERT_TRUE( run( baud ) );
+    TEST_ASSERT_EQUAL_UINT32( 115200, getbaud() );
+    TEST_ASSERT_EQUAL_UINT32( 115200, host );
+
+    // only the rate changed, not the port, its mode or protocols
+    TEST_ASSERT_EQUAL( 0x02, port[0] );
+    TEST_ASSERT_EQUAL( 0xC0, port[4] );
+    TEST_ASSERT_EQUAL( 0x08, port[5] );
+    TEST_ASSERT_EQUAL( 0x01, port[12] );
+    TEST_ASSERT_EQUAL( 0x01, port[14] );
+  }
+}
+
+void test_already_there()
+{
+  ubxbaud baud( 115200, setbaud );
+
+  reset( 115200 );
+  TEST_ASSERT_TRUE( run( baud ) );
+  TEST_ASSERT_EQUAL_UINT32( 115200, getbaud() );
+  TEST_ASSERT_EQUAL( 0, baud.getrounds() );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_switch_keeps_port );
+  RUN_TEST( test_already_there );
+  return UNITY_END();
+}
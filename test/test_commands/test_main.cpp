@@ -0,0 +1,207 @@
+/*
+  CFG commands through a ubxcommands queue, against a receiver that
+  answers by hand
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+// What the handler was told, one line per command done
+struct _done
+{
+  uint32_t ticket;
+  uint8_t id;
+  Reply reply;
+};
+
+static std::vector<_done> done;
+
+static void onreply( uint32_t ticket, uint8_t cl, uint8_t id, Reply reply, void *context )
+{
+  _done d = { ticket, id, reply };
+
+  done.push_back( d );
+}
+
+static void reply( ublox &gps, bool ack, uint8_t cl, uint8_t id )
+{
+  std::vector<uint8_t> f = ubxframeof( 0x05, ack ? 0x01 : 0x00, std::vector<uint8_t>{ cl, id } );
+
+  gps.parse( f.data(), f.size() );
+}
+
+// The class and id of every frame sent since the last call, then forgets them
+static std::vector<uint16_t> takesent()
+{
+  std::vector<uint16_t> ids;
+
+  for( size_t i = 0; i + 8 <= sent.size(); i += 8 + ( sent[i + 4] | sent[i + 5] << 8 ) )
+    ids.push_back( sent[i + 2] << 8 | sent[i + 3] );
+
+  sent.clear();
+  return ids;
+}
+
+static void start( ublox &gps, ubxcommands<> &commands )
+{
+  sent.clear();
+  done.clear();
+  gps.attach( commands );
+  commands.onreply( onreply );
+}
+
+// each reply completes the command with the same class and id
+void test_ack_nak()
+{
+  ublox gps;
+  ubxcommands<> commands;
+
+  start( gps, commands );
+  uint32_t pvt = commands.add<cfgnavpvton>();
+  uint32_t defaults = commands.add<cfgdefaults>();
+
+  commands.update( 0 );
+  TEST_ASSERT_EQUAL( 2, takesent().size() );
+  TEST_ASSERT_EQUAL( 2, commands.pending() );
+
+  reply( gps, false, 0x06, 0x09 );
+  reply( gps, true, 0x06, 0x02 );  // nobody asked
+  reply( gps, true, 0x06, 0x01 );
+
+  TEST_ASSERT_EQUAL( 0, commands.pending() );
+  TEST_ASSERT_EQUAL( 2, done.size() );
+  TEST_ASSERT_EQUAL_UINT32( defaults, done[0].ticket );
+  TEST_ASSERT_TRUE( done[0].reply == Reply::nak );
+  TEST_ASSERT_EQUAL_UINT32( pvt, done[1].ticket );
+  TEST_ASSERT_TRUE( done[1].reply == Reply::ack );
+  TEST_ASSERT_EQUAL_UINT32( 1, commands.getacks() );
+  TEST_ASSERT_EQUAL_UINT32( 1, commands.getnaks() );
+}
+
+// sent again every UBXCMDTIMEOUT until UBXCMDTRIES, then given up
+void test_retry_timeout()
+{
+  ublox gps;
+  ubxcommands<> commands;
+
+  start( gps, commands );
+  commands.add<cfgnavpvton>();
+
+  uint32_t now = 1000;
+  uint8_t sends = 0;
+
+  commands.update( now );
+  sends += takesent().size();
+
+  for( uint8_t i = 0; i < UBXCMDTRIES; i++ )
+  {
+    commands.update( now + UBXCMDTIMEOUT - 1 );
+    TEST_ASSERT_EQUAL( 0, takesent().size() );
+    TEST_ASSERT_EQUAL( 0, done.size() );
+    now += UBXCMDTIMEOUT;
+    commands.update( now );
+    sends += takesent().size();
+  }
+
+  TEST_ASSERT_EQUAL( UBXCMDTRIES, sends );
+  TEST_ASSERT_EQUAL( 1, done.size() );
+  TEST_ASSERT_TRUE( done[0].reply == Reply::timeout );
+  TEST_ASSERT_EQUAL_UINT32( 1, commands.gettimeouts() );
+  TEST_ASSERT_EQUAL( 0, commands.pending() );
+
+  reply( gps, true, 0x06, 0x01 );  // too late
+  TEST_ASSERT_EQUAL( 1, done.size() );
+}
+
+// no more than UBXCMDWINDOW in flight, the next goes out as one is done
+void test_window()
+{
+  ublox gps;
+  ubxcommands<> commands;
+  uint8_t frames[UBXCMDWINDOW + 2][10];
+
+  start( gps, commands );
+
+  for( uint8_t i = 0; i < UBXCMDWINDOW + 2; i++ )
+  {
+    std::vector<uint8_t> f = ubxframeof( 0x06, 0x40 + i, std::vector<uint8_t>{ 0, 0 } );
+
+    memcpy( frames[i], f.data(), sizeof( frames[i] ) );
+    commands.add( frames[i], sizeof( frames[i] ) );
+  }
+
+  commands.update( 0 );
+  TEST_ASSERT_EQUAL( UBXCMDWINDOW, takesent().size() );
+  commands.update( 1 );
+  TEST_ASSERT_EQUAL( 0, takesent().size() );
+
+  reply( gps, true, 0x06, 0x41 );
+  commands.update( 2 );
+
+  std::vector<uint16_t> ids = takesent();
+
+  TEST_ASSERT_EQUAL( 1, ids.size() );
+  TEST_ASSERT_EQUAL( 0x0640 + UBXCMDWINDOW, ids[0] );
+  TEST_ASSERT_EQUAL( UBXCMDWINDOW + 1, commands.pending() );
+}
+
+// a command held back behind one with the same class and id doesn't
+// hold up the ones after it
+void test_same_id()
+{
+  ublox gps;
+  ubxcommands<> commands;
+
+  start( gps, commands );
+  commands.add<cfgnavpvton>();
+  commands.add<cfgnavsaton>();   // also CFG-MSG
+  commands.add<cfgdefaults>();
+
+  commands.update( 0 );
+
+  std::vector<uint16_t> ids = takesent();
+
+  TEST_ASSERT_EQUAL( 2, ids.size() );
+  TEST_ASSERT_EQUAL( 0x0601, ids[0] );
+  TEST_ASSERT_EQUAL( 0x0609, ids[1] );
+
+  reply( gps, true, 0x06, 0x01 );
+  commands.update( 1 );
+  ids = takesent();
+  TEST_ASSERT_EQUAL( 1, ids.size() );
+  TEST_ASSERT_EQUAL( 0x0601, ids[0] );
+  TEST_ASSERT_EQUAL( 1, done.size() );
+}
+
+// several frames in one add are queued all together or not at all
+void test_all_or_nothing()
+{
+  ublox gps;
+  ubxcommands<4> commands;
+  std::vector<uint8_t> two( cfgnavpvton::data, cfgnavpvton::data + sizeof( cfgnavpvton::data ) );
+
+  two.insert( two.end(), cfgnavsaton::data, cfgnavsaton::data + sizeof( cfgnavsaton::data ) );
+  sent.clear();
+  gps.attach( commands );
+
+  TEST_ASSERT_TRUE( commands.add<cfgdefaults>() != 0 );
+  TEST_ASSERT_TRUE( commands.add<cfgdefaults>() != 0 );
+  TEST_ASSERT_EQUAL_UINT32( 0, commands.add<cfgnmeaoff>() );  // 20 frames
+  TEST_ASSERT_EQUAL( 2, commands.pending() );
+  TEST_ASSERT_EQUAL_UINT32( 0, commands.add( two.data(), two.size() - 1 ) );  // cut short
+  TEST_ASSERT_EQUAL( 2, commands.pending() );
+  TEST_ASSERT_TRUE( commands.add( two.data(), two.size() ) != 0 );
+  TEST_ASSERT_EQUAL( 4, commands.pending() );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_ack_nak );
+  RUN_TEST( test_retry_timeout );
+  RUN_TEST( test_window );
+  RUN_TEST( test_same_id );
+  RUN_TEST( test_all_or_nothing );
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+/*
+  ubxconfig against a simulated receiver: what a cold receiver and one
+  that already has the configuration are sent
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+// The receiver's state, the NAV-PVT rate on every port and CFG-TP5's
+// pulseLenRatio
+static uint8_t pvtrates[6];
+static uint32_t pulse;
+
+static ublox gps;
+
+static void frame( uint8_t cl, uint8_t id, const std::vector<uint8_t> &payload )
+{
+  std::vector<uint8_t> f = ubxframeof( cl, id, payload );
+
+  gps.parse( f.data(), f.size() );
+}
+
+// Answers polls and takes and ACKs the rest. Counts what it was sent.
+struct _traffic
+{
+  int polls;
+  int sets;
+};
+
+static void receiver( _traffic &t )
+{
+  std::vector<uint8_t> in;
+
+  in.swap( sent );
+
+  for( size_t i = 0; i + 8 <= in.size(); i += 8 + ( in[i + 4] | in[i + 5] << 8 ) )
+  {
+    uint8_t id = in[i + 3];
+    uint16_t length = in[i + 4] | in[i + 5] << 8;
+    const uint8_t *p = &in[i + 6];
+
+    if( in[i + 2] != 0x06 )
+      continue;
+
+    if( length == 0 || ( id == 0x01 && length == 2 ) )
+    {
+      t.polls++;
+
+      if( id == 0x31 )
+      {
+        std::vector<uint8_t> payload( 32, 0 );
+
+        memcpy( &payload[16], &pulse, 4 );
+        frame( 0x06, 0x31, payload );
+      }
+      else if( id == 0x01 )
+      {
+        std::vector<uint8_t> payload = { p[0], p[1] };
+
+        payload.insert( payload.end(), pvtrates, pvtrates + 6 );
+        frame( 0x06, 0x01, payload );
+      }
+    }
+    else
+    {
+      t.sets++;
+
+      if( id == 0x31 )
+        memcpy( &pulse, &p[16], 4 );
+      else if( id == 0x01 && length == 8 )
+        memcpy( pvtrates, &p[2], 6 );
+
+      frame( 0x05, 0x01, std::vector<uint8_t>{ 0x06, id } );
+    }
+  }
+}
+
+static void slowpulse( cfgtp5 &tp5, void *context )
+{
+  tp5.setPulseLenRatio( 500000 );
+}
+
+// Runs apply() to the end the way the loop would
+static _traffic run( ubxconfig<> &config, ubxpolls<> &polls, ubxcommands<> &commands, uint32_t &now )
+{
+  _traffic t = {};
+
+  config.apply();
+
+  for( int i = 0; i < 20; i++, now += 50 )
+  {
+    config.update( now );
+    polls.update( now );
+    commands.update( now );
+    receiver( t );
+  }
+
+  return t;
+}
+
+void test_cold_and_warm()
+{
+  ubxpolls<> polls;
+  ubxcommands<> commands;
+  ubxconfig<> config( polls, commands );
+  uint32_t now = 0;
+
+  memset( pvtrates, 0, sizeof( pvtrates ) );
+  pulse = 100000;
+  sent.clear();
+  gps.attach( polls );
+  gps.attach( commands );
+
+  config.message( 0x01, 0x07, 1 );
+  config.change<cfgtp5>( slowpulse );
+
+  // cold, both differ so both are sent and acknowledged
+  _traffic cold = run( config, polls, commands, now );
+
+  TEST_ASSERT_TRUE( config.isdone() );
+  TEST_ASSERT_EQUAL( 2, cold.polls );
+  TEST_ASSERT_EQUAL( 2, cold.sets );
+  TEST_ASSERT_EQUAL_UINT32( 2, config.getchanged() );
+  TEST_ASSERT_EQUAL_UINT32( 0, config.getunchanged() );
+  TEST_ASSERT_EQUAL_UINT32( 2, commands.getacks() );
+  TEST_ASSERT_EQUAL( 0, commands.pending() );
+  TEST_ASSERT_EQUAL( 1, pvtrates[UBXPORT] );
+  TEST_ASSERT_EQUAL( 0, pvtrates[0] );
+  TEST_ASSERT_EQUAL_UINT32( 500000, pulse );
+
+  // warm, nothing but the polls
+  _traffic warm = run( config, polls, commands, now );
+
+  TEST_ASSERT_TRUE( config.isdone() );
+  TEST_ASSERT_EQUAL( 2, warm.polls );
+  TEST_ASSERT_EQUAL( 0, warm.sets );
+  TEST_ASSERT_EQUAL_UINT32( 2, config.getchanged() );
+  TEST_ASSERT_EQUAL_UINT32( 2, config.getunchanged() );
+  TEST_ASSERT_EQUAL_UINT32( 2, commands.getacks() );
+  TEST_ASSERT_EQUAL_UINT32( 0, config.getfailed() );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_cold_and_warm );
+  return UNITY_END();
+}
@@ -0,0 +1,119 @@
+/*
+  UBX, NMEA and RTCM3 out of one stream through a ubxdemux
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+static int sentences;
+
+static void onnmea( const char *sentence, uint16_t length, void *context )
+{
+  sentences++;
+}
+
+static std::vector<uint8_t> gga()
+{
+  const char *s = "$GPGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,*5B\r\n";
+
+  return std::vector<uint8_t>( s, s + strlen( s ) );
+}
+
+// An RXM-RAWX of n signals, longer than the demux keeps once n is 33 or more
+static std::vector<uint8_t> rawx( uint32_t k, uint8_t n )
+{
+  std::vector<uint8_t> payload( 16 + 32 * n, 0 );
+  double tow = k;
+
+  memcpy( &payload[0], &tow, 8 );
+  payload[11] = n;
+  for( uint8_t i = 0; i < n; i++ )
+    payload[16 + 32 * i + 21] = i;
+
+  return ubxframeof( 0x02, 0x15, payload );
+}
+
+static std::vector<uint8_t> stream;
+
+static void add( const std::vector<uint8_t> &f )
+{
+  stream.insert( stream.end(), f.begin(), f.end() );
+}
+
+// Feeds the stream in chunks of the given size
+static void run( ubxdemux<> &demux, size_t chunk )
+{
+  for( size_t i = 0; i < stream.size(); i += chunk )
+    demux.parse( &stream[i], stream.size() - i < chunk ? stream.size() - i : chunk );
+}
+
+void test_long_rawx()
+{
+  std::vector<uint8_t> bad = rawx( 3, 40 );
+
+  bad.back() ^= 1;
+  stream.clear();
+  add( gga() );
+  add( rawx( 1, 40 ) );
+  add( gga() );
+  add( rawx( 2, 8 ) );
+  add( bad );
+  add( gga() );
+  add( rawx( 4, 60 ) );
+  add( gga() );
+
+  size_t chunks[] = { 1, 7, 64, 1000, 4096 };
+
+  for( size_t c : chunks )
+  {
+    ublox gps;
+    ubxraw<256, 8> raw;
+    ubxdemux<> demux( gps );
+
+    sentences = 0;
+    raw.attach( gps );
+    demux.onnmea( onnmea );
+    run( demux, c );
+
+    TEST_ASSERT_EQUAL( 4, sentences );
+    TEST_ASSERT_EQUAL( 3, demux.getubx() );
+    TEST_ASSERT_EQUAL( 0, demux.getfalsestarts() );
+    TEST_ASSERT_EQUAL( 3, raw.available() );
+    TEST_ASSERT_EQUAL( 1, raw.getdropped() );
+    TEST_ASSERT_EQUAL( 40, raw.front().count );
+    raw.pop();
+    TEST_ASSERT_EQUAL( 8, raw.front().count );
+    raw.pop();
+    TEST_ASSERT_EQUAL( 60, raw.front().count );
+    TEST_ASSERT_EQUAL( 59, raw.svId[raw.front().first + 59] );
+  }
+}
+
+// Nothing streams RAWX, so a long one is a false start (as may be bytes in
+// it) and costs no bytes
+void test_long_not_streamed()
+{
+  ublox gps;
+  ubxdemux<> demux( gps );
+
+  stream.clear();
+  add( rawx( 1, 40 ) );
+  add( gga() );
+
+  sentences = 0;
+  demux.onnmea( onnmea );
+  run( demux, 64 );
+
+  TEST_ASSERT_EQUAL( 1, sentences );
+  TEST_ASSERT_EQUAL( 0, demux.getubx() );
+  TEST_ASSERT_GREATER_THAN( 0, demux.getfalsestarts() );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_long_rawx );
+  RUN_TEST( test_long_not_streamed );
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+/*
+  NAV packets grouped into epochs by ubxepoch
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+typedef ubxepoch<navpvt8, navsat> navepoch;
+
+// What a handler saw, one line per hand over
+struct _seen
+{
+  uint32_t iTOW;
+  bool pvt;
+  int svs;    // -1 without NAV-SAT
+};
+
+static std::vector<_seen> seen;
+
+static void onepoch( const navepoch &epoch, void *context )
+{
+  _seen s = { epoch.getiTOW(), epoch.has<navpvt8>(), epoch.has<navsat>() ? epoch.get<navsat>().getnumSvs() : -1 };
+
+  seen.push_back( s );
+}
+
+static std::vector<uint8_t> payload( uint32_t iTOW, size_t n )
+{
+  std::vector<uint8_t> p( n, 0 );
+
+  memcpy( &p[0], &iTOW, 4 );
+  return p;
+}
+
+static std::vector<uint8_t> pvt( uint32_t iTOW )
+{
+  return ubxframeof( 0x01, 0x07, payload( iTOW, 92 ) );
+}
+
+static std::vector<uint8_t> sat( uint32_t iTOW, uint8_t svs )
+{
+  std::vector<uint8_t> p = payload( iTOW, 8 + 12 * svs );
+
+  p[5] = svs;
+  return ubxframeof( 0x01, 0x35, p );
+}
+
+static std::vector<uint8_t> eoe( uint32_t iTOW )
+{
+  return ubxframeof( 0x01, 0x61, payload( iTOW, 4 ) );
+}
+
+static void feed( ublox &gps, const std::vector<uint8_t> &f )
+{
+  gps.parse( f.data(), f.size() );
+}
+
+static void check( size_t k, uint32_t iTOW, bool pvt, int svs )
+{
+  TEST_ASSERT_TRUE( k < seen.size() );
+  TEST_ASSERT_EQUAL_UINT32( iTOW, seen[k].iTOW );
+  TEST_ASSERT_EQUAL( pvt, seen[k].pvt );
+  TEST_ASSERT_EQUAL( svs, seen[k].svs );
+}
+
+// both expected, an epoch missing NAV-SAT closes when the next one starts
+void test_all_expected()
+{
+  ublox gps;
+  navepoch epoch( onepoch );
+
+  seen.clear();
+  gps.attach( epoch );
+  feed( gps, pvt( 1000 ) );
+  feed( gps, sat( 1000, 3 ) );
+  feed( gps, eoe( 1000 ) );
+  feed( gps, pvt( 2000 ) );
+  feed( gps, pvt( 3000 ) );
+  feed( gps, sat( 3000, 4 ) );
+
+  TEST_ASSERT_EQUAL( 3, seen.size() );
+  check( 0, 1000, true, 3 );
+  check( 1, 2000, true, -1 );
+  check( 2, 3000, true, 4 );
+  TEST_ASSERT_EQUAL_UINT32( 3, epoch.getepochs() );
+  TEST_ASSERT_EQUAL_UINT32( 0, epoch.getlate() );
+}
+
+// NAV-PVT closes the epoch, NAV-SAT behind it every other second must
+// still reach the handler
+void test_late_member()
+{
+  ublox gps;
+  navepoch epoch( onepoch );
+
+  seen.clear();
+  gps.attach( epoch );
+  epoch.expect<navpvt8>();
+  feed( gps, pvt( 1000 ) );
+  feed( gps, sat( 1000, 3 ) );
+  feed( gps, eoe( 1000 ) );
+  feed( gps, pvt( 2000 ) );
+  feed( gps, eoe( 2000 ) );
+  feed( gps, pvt( 3000 ) );
+  feed( gps, sat( 3000, 5 ) );
+  feed( gps, sat( 3000, 6 ) );  // a repeat, ignored
+
+  TEST_ASSERT_EQUAL( 5, seen.size() );
+  check( 0, 1000, true, -1 );
+  check( 1, 1000, true, 3 );
+  check( 2, 2000, true, -1 );
+  check( 3, 3000, true, -1 );
+  check( 4, 3000, true, 5 );
+  TEST_ASSERT_EQUAL_UINT32( 3, epoch.getepochs() );
+  TEST_ASSERT_EQUAL_UINT32( 2, epoch.getlate() );
+}
+
+// nothing expected, only NAV-EOE closes and only once
+void test_eoe()
+{
+  ublox gps;
+  navepoch epoch( onepoch );
+
+  seen.clear();
+  gps.attach( epoch );
+  epoch.expect<>();
+  feed( gps, pvt( 1000 ) );
+  feed( gps, sat( 1000, 2 ) );
+  TEST_ASSERT_EQUAL( 0, seen.size() );
+  feed( gps, eoe( 1000 ) );
+  feed( gps, eoe( 1000 ) );
+  feed( gps, sat( 2000, 4 ) );
+  feed( gps, eoe( 2000 ) );
+
+  TEST_ASSERT_EQUAL( 2, seen.size() );
+  check( 0, 1000, true, 2 );
+  check( 1, 2000, false, 4 );
+  TEST_ASSERT_EQUAL_UINT32( 2, epoch.getepochs() );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_all_expected );
+  RUN_TEST( test_late_member );
+  RUN_TEST( test_eoe );
+  return UNITY_END();
+}
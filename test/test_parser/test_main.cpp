@@ -0,0 +1,236 @@
+/*
+  The checksum is kept as the packet comes in, so finishing a 1 KB NAV-SAT
+  costs no more than finishing a short packet. Real packets after a false
+  start are still found, whichever way the parser is fed.
+*/
+
+#include <unity.h>
+#include <stdlib.h>
+#include "../ubxtest.h"
+
+static uint32_t good;
+
+static void onsat( navsat &sat )
+{
+  good++;
+}
+
+// NAV-SAT with 84 satellites, a 1024 byte frame
+static std::vector<uint8_t> navsatframe()
+{
+  std::vector<uint8_t> payload( 8 + 12 * 84 );
+
+  for( size_t i = 0; i < payload.size(); i++ )
+    payload[i] = (uint8_t)( i * 7 + 3 );
+  payload[5] = 84;
+
+  return ubxframeof( 0x01, 0x35, payload );
+}
+
+void test_checksum()
+{
+  std::vector<uint8_t> f = navsatframe();
+  ublox gps;
+
+  TEST_ASSERT_EQUAL( 1024, f.size() );
+  gps.on<navsat>( onsat );
+  good = 0;
+
+  // any chunking gives the same sums
+  for( size_t chunk = 1; chunk <= f.size(); chunk += 37 )
+    for( size_t i = 0; i < f.size(); i += chunk )
+      gps.parse( &f[i], f.size() - i < chunk ? f.size() - i : chunk );
+
+  TEST_ASSERT_EQUAL( 28, good );
+  TEST_ASSERT_EQUAL( 0, gps.getchecksumerrors() );
+
+  // a byte anywhere in the header or payload is caught
+  for( size_t i = 2; i < f.size() - 2; i += 101 )
+  {
+    f[i] ^= 0x10;
+    gps.parse( f.data(), f.size() );
+    f[i] ^= 0x10;
+  }
+
+  TEST_ASSERT_EQUAL( 28, good );
+  TEST_ASSERT_TRUE( gps.getchecksumerrors() > 0 );
+}
+
+static std::vector<uint8_t> ackframe( uint8_t id )
+{
+  std::vector<uint8_t> payload = { 0x06, id };
+
+  return ubxframeof( 0x05, 0x01, payload );
+}
+
+// A header that looks like an unregistered packet of 300 bytes, in front
+// of the packets that follow it
+void test_false_header()
+{
+  std::vector<uint8_t> data = { 0xB5, 0x62, 0x0A, 0x77, 0x2C, 0x01 };
+
+  for( uint8_t i = 0; i < 10; i++ )
+  {
+    std::vector<uint8_t> f = ackframe( i );
+    data.insert( data.end(), f.begin(), f.end() );
+  }
+
+  ublox bytes;
+  ublox chunk;
+  ublox ring;
+  ubxframes got[3];
+
+  bytes.onframe( collect, &got[0] );
+  chunk.onframe( collect, &got[1] );
+  ring.onframe( collect, &got[2] );
+
+  for( uint8_t c : data )
+    bytes.parse( c );
+  chunk.parse( data.data(), data.size() );
+  ringfeed( ring, data, 512, 64 );
+
+  for( int i = 0; i < 3; i++ )
+  {
+    TEST_ASSERT_EQUAL( 10, got[i].size() );
+    for( uint8_t k = 0; k < 10; k++ )
+      TEST_ASSERT_EQUAL( k, got[i][k][5] );
+  }
+}
+
+// A packet cut short, or a header out of noise, swallows the packets
+// behind it until its checksum fails. They are found again in the bytes
+// kept for it, by byte and by buffer alike.
+void test_recovered()
+{
+  std::vector<uint8_t> pvt = ubxframeof( 0x01, 0x07, std::vector<uint8_t>( 92, 0x33 ) );
+  std::vector<uint8_t> cut( pvt.begin(), pvt.begin() + 2 + 4 + 30 );
+  std::vector<uint8_t> noise = { 0xB5, 0x62, 0x01, 0x07, 0x5C, 0x00 };
+  const std::vector<uint8_t> *bad[] = { &cut, &noise };
+  const uint32_t inside[] = { 6, 9 };  // whole ACKs in the 64 and 94 bytes swallowed
+
+  for( int b = 0; b < 2; b++ )
+  {
+    std::vector<uint8_t> data = *bad[b];
+
+    for( uint8_t i = 0; i < 10; i++ )
+    {
+      std::vector<uint8_t> f = ackframe( i );
+      data.insert( data.end(), f.begin(), f.end() );
+    }
+
+    ublox bytes;
+    ublox chunk;
+    ubxframes got[2];
+
+    bytes.onframe( collect, &got[0] );
+    chunk.onframe( collect, &got[1] );
+
+    for( uint8_t c : data )
+      bytes.parse( c );
+    chunk.parse( data.data(), data.size() );
+
+    ublox *parsers[] = { &bytes, &chunk };
+
+    for( int i = 0; i < 2; i++ )
+    {
+      TEST_ASSERT_EQUAL( 10, got[i].size() );
+      for( uint8_t k = 0; k < 10; k++ )
+        TEST_ASSERT_EQUAL( k, got[i][k][5] );
+      TEST_ASSERT_EQUAL_UINT32( 1, parsers[i]->getchecksumerrors() );
+      TEST_ASSERT_EQUAL_UINT32( 1, parsers[i]->getresyncs() );
+      TEST_ASSERT_EQUAL_UINT32( inside[b], parsers[i]->getrecovered() );
+    }
+  }
+}
+
+// Noise full of false starts around real packets, all three ways of
+// feeding the parser find every packet
+void test_noise()
+{
+  std::vector<uint8_t> data;
+  ubxframes sent;
+
+  srand( 5 );
+  for( int i = 0; i < 400; i++ )
+  {
+    int noise = rand() % 40;
+
+    for( int k = 0; k < noise; k++ )
+      data.push_back( rand() % 4 ? rand() : rand() % 2 ? 0xB5 : 0x62 );
+
+    if( rand() % 4 == 0 )
+    {
+      uint16_t len = rand() % 2048;
+      uint8_t header[] = { 0xB5, 0x62, (uint8_t)( rand() % 2 ? 0x0A : 0x01 ), (uint8_t)rand(), (uint8_t)len, (uint8_t)( len >> 8 ) };
+
+      data.insert( data.end(), header, header + sizeof( header ) );
+    }
+
+    std::vector<uint8_t> f = rand() % 2 ? ackframe( i ) : ubxframeof( 0x01, 0x61, std::vector<uint8_t>( 4, (uint8_t)i ) );
+
+    sent.push_back( std::vector<uint8_t>( f.begin() + 2, f.end() - 2 ) );
+    data.insert( data.end(), f.begin(), f.end() );
+  }
+
+  ublox bytes;
+  ublox chunk;
+  ublox ring;
+  ubxframes got[3];
+
+  bytes.onframe( collect, &got[0] );
+  chunk.onframe( collect, &got[1] );
+  ring.onframe( collect, &got[2] );
+
+  for( uint8_t c : data )
+    bytes.parse( c );
+  for( size_t i = 0; i < data.size(); i += 97 )
+    chunk.parse( &data[i], std::min<size_t>( 97, data.size() - i ) );
+  ringfeed( ring, data, 2048, 97 );
+
+  for( int i = 0; i < 3; i++ )
+    TEST_ASSERT_TRUE( got[i] == sent );
+}
+
+static volatile uint8_t sink;
+
+// How long the last byte of the frame takes, which is when the loop wants
+// to act on the packet, against summing the whole frame there as the
+// parser used to
+void test_benchmark()
+{
+  std::vector<uint8_t> f = navsatframe();
+  const int n = 20000;
+  uint64_t last = 0;
+  uint64_t full = 0;
+  uint8_t ck[2];
+  ublox gps;
+
+  for( int i = 0; i < n; i++ )
+  {
+    gps.parse( f.data(), f.size() - 1 );
+
+    uint64_t t0 = nanos();
+    gps.parse( &f[f.size() - 1], 1 );
+    uint64_t t1 = nanos();
+    ubxchecksum( ck, &f[2], f.size() - 4 );
+    uint64_t t2 = nanos();
+
+    sink = ck[0] ^ ck[1];
+    last += t1 - t0;
+    full += t2 - t1;
+  }
+
+  report( "end of frame, running checksum", (double)last / n );
+  report( "end of frame, whole frame summed", (double)( last + full ) / n );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_checksum );
+  RUN_TEST( test_false_header );
+  RUN_TEST( test_recovered );
+  RUN_TEST( test_noise );
+  RUN_TEST( test_benchmark );
+  return UNITY_END();
+}
@@ -0,0 +1,184 @@
+/*
+  Poll replies routed by ubxpolls among periodic traffic
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+// What one requester was handed
+struct _asker
+{
+  int replies;
+  int timeouts;
+  uint32_t value;   // pulseLenRatio of a CFG-TP5, baudRate of a CFG-PRT
+};
+
+static void ontp5( cfgtp5 *tp5, void *context )
+{
+  _asker &a = *(_asker *)context;
+
+  if( tp5 == nullptr )
+    a.timeouts++;
+  else
+  {
+    a.replies++;
+    a.value = tp5->getPulseLenRatio();
+  }
+}
+
+static void onprt( cfgprt *prt, void *context )
+{
+  _asker &a = *(_asker *)context;
+
+  if( prt == nullptr )
+    a.timeouts++;
+  else
+  {
+    a.replies++;
+    a.value = prt->getBaudRate();
+  }
+}
+
+static void feed( ublox &gps, const std::vector<uint8_t> &f )
+{
+  gps.parse( f.data(), f.size() );
+}
+
+static std::vector<uint8_t> tp5( uint32_t ratio )
+{
+  std::vector<uint8_t> payload( 32, 0 );
+
+  memcpy( &payload[16], &ratio, 4 );
+  return ubxframeof( 0x06, 0x31, payload );
+}
+
+static std::vector<uint8_t> prt( uint8_t port, uint32_t baud )
+{
+  std::vector<uint8_t> payload( 20, 0 );
+
+  payload[0] = port;
+  memcpy( &payload[8], &baud, 4 );
+  return ubxframeof( 0x06, 0x00, payload );
+}
+
+static std::vector<uint8_t> pvt()
+{
+  return ubxframeof( 0x01, 0x07, std::vector<uint8_t>( 92, 0 ) );
+}
+
+// polls for CFG-PRT on port 1 and 2
+static const uint8_t prt1[] = { 0xB5, 0x62, 0x06, 0x00, 0x01, 0x00, 0x01, 0x08, 0x22 };
+static const uint8_t prt2[] = { 0xB5, 0x62, 0x06, 0x00, 0x01, 0x00, 0x02, 0x09, 0x23 };
+
+// each reply goes to the one that asked for it, once, whatever comes
+// in between
+void test_route()
+{
+  ublox gps;
+  ubxpolls<> polls;
+  _asker a = {};
+  _asker b = {};
+  _asker c = {};
+
+  gps.attach( polls );
+  sent.clear();
+  TEST_ASSERT_TRUE( polls.poll( ontp5, 0, &a ) );
+  TEST_ASSERT_TRUE( polls.poll( prt1, sizeof( prt1 ), onprt, 0, &b ) );
+  TEST_ASSERT_TRUE( polls.poll( prt2, sizeof( prt2 ), onprt, 0, &c ) );
+  TEST_ASSERT_EQUAL( 3, polls.pending() );
+  TEST_ASSERT_EQUAL_UINT32( 3, polls.getsent() );
+  TEST_ASSERT_EQUAL( 8 + 9 + 9, sent.size() );
+
+  feed( gps, pvt() );
+  feed( gps, prt( 2, 115200 ) );
+  feed( gps, pvt() );
+  TEST_ASSERT_EQUAL( 0, a.replies );
+  TEST_ASSERT_EQUAL( 0, b.replies );
+  TEST_ASSERT_EQUAL( 1, c.replies );
+  TEST_ASSERT_EQUAL_UINT32( 115200, c.value );
+
+  feed( gps, tp5( 100000 ) );
+  feed( gps, prt( 1, 9600 ) );
+  feed( gps, tp5( 200000 ) );  // nobody waiting any more
+  feed( gps, prt( 2, 38400 ) );
+
+  TEST_ASSERT_EQUAL( 1, a.replies );
+  TEST_ASSERT_EQUAL_UINT32( 100000, a.value );
+  TEST_ASSERT_EQUAL( 1, b.replies );
+  TEST_ASSERT_EQUAL_UINT32( 9600, b.value );
+  TEST_ASSERT_EQUAL( 1, c.replies );
+  TEST_ASSERT_EQUAL_UINT32( 115200, c.value );
+  TEST_ASSERT_EQUAL( 0, polls.pending() );
+  TEST_ASSERT_EQUAL_UINT32( 0, polls.getexpired() );
+}
+
+// sent again after UBXPOLLRESEND, given up at the deadline
+void test_timeout()
+{
+  ublox gps;
+  ubxpolls<> polls;
+  _asker a = {};
+
+  gps.attach( polls );
+  polls.poll( ontp5, 1000, &a );
+
+  polls.update( 1000 + UBXPOLLRESEND - 1 );
+  TEST_ASSERT_EQUAL_UINT32( 1, polls.getsent() );
+  polls.update( 1000 + UBXPOLLRESEND );
+  TEST_ASSERT_EQUAL_UINT32( 2, polls.getsent() );
+
+  feed( gps, pvt() );
+  polls.update( 1000 + UBXPOLLTIMEOUT - 1 );
+  TEST_ASSERT_EQUAL( 0, a.timeouts );
+  polls.update( 1000 + UBXPOLLTIMEOUT );
+  TEST_ASSERT_EQUAL( 1, a.timeouts );
+  TEST_ASSERT_EQUAL( 0, a.replies );
+  TEST_ASSERT_EQUAL_UINT32( 1, polls.getexpired() );
+  TEST_ASSERT_EQUAL( 0, polls.pending() );
+
+  feed( gps, tp5( 100000 ) );  // too late
+  polls.update( 1000 + 2 * UBXPOLLTIMEOUT );
+  TEST_ASSERT_EQUAL( 0, a.replies );
+  TEST_ASSERT_EQUAL( 1, a.timeouts );
+}
+
+// two requesters for the same packet, one poll goes out and both get
+// the one reply
+void test_shared()
+{
+  ublox gps;
+  ubxpolls<> polls;
+  _asker a = {};
+  _asker b = {};
+
+  gps.attach( polls );
+  sent.clear();
+  polls.poll( ontp5, 0, &a );
+  polls.poll( ontp5, 10, &b );
+
+  TEST_ASSERT_EQUAL_UINT32( 1, polls.getsent() );
+  TEST_ASSERT_EQUAL_UINT32( 1, polls.getshared() );
+  TEST_ASSERT_EQUAL( 8, sent.size() );
+
+  polls.update( UBXPOLLRESEND );  // goes again once for both
+  TEST_ASSERT_EQUAL_UINT32( 2, polls.getsent() );
+
+  feed( gps, tp5( 300000 ) );
+  feed( gps, tp5( 400000 ) );
+
+  TEST_ASSERT_EQUAL( 1, a.replies );
+  TEST_ASSERT_EQUAL( 1, b.replies );
+  TEST_ASSERT_EQUAL_UINT32( 300000, a.value );
+  TEST_ASSERT_EQUAL_UINT32( 300000, b.value );
+  TEST_ASSERT_EQUAL( 0, polls.pending() );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_route );
+  RUN_TEST( test_timeout );
+  RUN_TEST( test_shared );
+  return UNITY_END();
+}
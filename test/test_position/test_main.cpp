@@ -0,0 +1,101 @@
+/*
+  Integer position helpers against the same sums done in double
+*/
+
+#include <unity.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../ubxtest.h"
+
+// great circle distance in mm on the same sphere
+static double haversine( int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2 )
+{
+  const double r = M_PI / 180 * 1e-7;
+  double dlat = ( (double)lat2 - lat1 ) * r;
+  double dlon = ( (double)lon2 - lon1 ) * r;
+  double h = sin( dlat / 2 ) * sin( dlat / 2 ) + cos( lat1 * r ) * cos( lat2 * r ) * sin( dlon / 2 ) * sin( dlon / 2 );
+
+  return 2 * 6371008.8e3 * asin( sqrt( h ) );
+}
+
+void test_cos15()
+{
+  for( int32_t lat = -900000000; lat <= 900000000; lat += 12345 )
+    TEST_ASSERT_TRUE( fabs( ubxcos15( lat ) / 32768.0 - cos( lat * 1e-7 * M_PI / 180 ) ) < 6e-5 );
+}
+
+void test_isqrt()
+{
+  TEST_ASSERT_EQUAL_UINT32( 0, ubxisqrt( 0 ) );
+  TEST_ASSERT_EQUAL_UINT32( 9, ubxisqrt( 99 ) );
+  TEST_ASSERT_EQUAL_UINT32( 10, ubxisqrt( 100 ) );
+  TEST_ASSERT_EQUAL_UINT32( UINT32_MAX, ubxisqrt( UINT64_MAX ) );
+}
+
+void test_offsets()
+{
+  TEST_ASSERT_EQUAL_INT32( 111195080, ubxnorth( 0, ubxdeg7 ) );
+  TEST_ASSERT_EQUAL_INT32( -111195080, ubxnorth( ubxdeg7, 0 ) );
+  TEST_ASSERT_EQUAL_INT32( 111195080, ubxeast( 0, 0, ubxdeg7 ) );
+  TEST_ASSERT_INT32_WITHIN( 10, 55597540, ubxeast( 60 * ubxdeg7, 0, ubxdeg7 ) );
+
+  // the short way across 180 degrees
+  TEST_ASSERT_EQUAL_INT32( 22, ubxeast( 0, 1799999999, -1799999999 ) );
+  TEST_ASSERT_EQUAL_INT32( -22, ubxeast( 0, -1799999999, 1799999999 ) );
+}
+
+// short distances agree with the great circle to well under a percent
+void test_near()
+{
+  srand( 1 );
+  for( int k = 0; k < 100000; k++ )
+  {
+    int32_t lat1 = (int32_t)( ( rand() / (double)RAND_MAX * 2 - 1 ) * 85e7 );
+    int32_t lon1 = (int32_t)( ( rand() / (double)RAND_MAX * 2 - 1 ) * 179e7 );
+    int32_t lat2 = lat1 + ( rand() % 2000001 - 1000000 ) * 10;
+    int32_t lon2 = lon1 + ( rand() % 2000001 - 1000000 ) * 10;
+    double ref = haversine( lat1, lon1, lat2, lon2 );
+    uint32_t d = ubxdistance( lat1, lon1, lat2, lon2 );
+
+    TEST_ASSERT_TRUE( fabs( d - ref ) <= ref * 0.001 + 1 );
+    TEST_ASSERT_TRUE( ubxwithin( lat1, lon1, lat2, lon2, d + 1 ) );
+    if( d )
+      TEST_ASSERT_FALSE( ubxwithin( lat1, lon1, lat2, lon2, d - 1 ) );
+  }
+}
+
+// far apart nothing wraps, the offsets clamp and the distance saturates
+void test_far()
+{
+  TEST_ASSERT_EQUAL_INT32( INT32_MAX, ubxnorth( 0, 30 * ubxdeg7 ) );
+  TEST_ASSERT_EQUAL_INT32( -INT32_MAX, ubxnorth( 30 * ubxdeg7, 0 ) );
+  TEST_ASSERT_EQUAL_INT32( INT32_MAX, ubxeast( 0, 0, 30 * ubxdeg7 ) );
+  TEST_ASSERT_EQUAL_INT32( -INT32_MAX, ubxeast( 0, 0, -30 * ubxdeg7 ) );
+
+  TEST_ASSERT_FALSE( ubxwithin( 0, 0, 386255155, 0, 1000 ) );
+  TEST_ASSERT_FALSE( ubxwithin( 0, 0, 386255155, 0, UINT32_MAX ) );
+  TEST_ASSERT_FALSE( ubxwithin( -900000000, 0, 900000000, 0, UINT32_MAX ) );
+  TEST_ASSERT_FALSE( ubxwithin( 0, -1800000000, 0, 0, UINT32_MAX ) );
+  TEST_ASSERT_EQUAL_UINT64( UINT64_MAX, ubxdistance2( -900000000, 0, 900000000, 0 ) );
+  TEST_ASSERT_EQUAL_UINT32( UINT32_MAX, ubxdistance( -900000000, 0, 900000000, 0 ) );
+
+  // and every distance up to there is monotonic in the separation
+  uint32_t last = 0;
+  for( int32_t lat = 0; lat <= 900000000; lat += 100000 )
+  {
+    uint32_t d = ubxdistance( 0, 0, lat, 0 );
+    TEST_ASSERT_TRUE( d >= last );
+    last = d;
+  }
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_cos15 );
+  RUN_TEST( test_isqrt );
+  RUN_TEST( test_offsets );
+  RUN_TEST( test_near );
+  RUN_TEST( test_far );
+  return UNITY_END();
+}
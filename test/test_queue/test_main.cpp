@@ -0,0 +1,185 @@
+/*
+  Packets through a ubxqueue from a parser thread to a consumer thread
+*/
+
+#include <unity.h>
+#include <string.h>
+#include <thread>
+#include "../ubxtest.h"
+
+// NAV-SAT k, with k in iTOW and a length that changes so the records
+// wrap around the end of the queue at different places
+static std::vector<uint8_t> satframe( uint32_t k )
+{
+  uint8_t svs = k % 23;
+  std::vector<uint8_t> payload( 8 + 12 * svs );
+
+  memcpy( &payload[0], &k, 4 );
+  payload[5] = svs;
+  for( size_t i = 8; i < payload.size(); i++ )
+    payload[i] = (uint8_t)( k + i );
+
+  return ubxframeof( 0x01, 0x35, payload );
+}
+
+// The packet as queued is the frame without sync and checksum
+static bool same( const ubxframe &frame, uint32_t k )
+{
+  std::vector<uint8_t> f = satframe( k );
+
+  return frame.message == Message::navsat && frame.length == f.size() - 4 && memcmp( frame.data, &f[2], frame.length ) == 0;
+}
+
+static uint32_t sequence( const ubxframe &frame )
+{
+  return ubxget<uint32_t>( frame.data + sizeof( _header ) );
+}
+
+// Nothing may be lost when the producer waits for room, so every packet
+// comes out once and in order
+void test_order()
+{
+  const uint32_t n = 20000;
+  ubxqueue<1024> queue;
+  uint32_t full = 0;
+  uint32_t bad = 0;
+  uint32_t got = 0;
+
+  std::thread producer( [&]()
+  {
+    for( uint32_t k = 0; k < n; k++ )
+    {
+      std::vector<uint8_t> f = satframe( k );
+      ubxframe frame = { Message::navsat, &f[2], (uint16_t)( f.size() - 4 ) };
+
+      while( !queue.push( frame ) )
+      {
+        full++;
+        std::this_thread::yield();
+      }
+    }
+  } );
+
+  std::thread consumer( [&]()
+  {
+    ubxframe frame;
+
+    while( got < n )
+    {
+      if( !queue.front( frame ) )
+      {
+        std::this_thread::yield();
+        continue;
+      }
+
+      if( sequence( frame ) != got || !same( frame, got ) )
+        bad++;
+
+      got++;
+      queue.pop();
+    }
+  } );
+
+  producer.join();
+  consumer.join();
+
+  TEST_ASSERT_EQUAL_UINT32( n, got );
+  TEST_ASSERT_EQUAL_UINT32( 0, bad );
+  TEST_ASSERT_EQUAL_UINT32( n, queue.getpushed() );
+  TEST_ASSERT_EQUAL_UINT32( full, queue.getoverflows() );
+  TEST_ASSERT_TRUE( queue.empty() );
+}
+
+// A parser feeding a consumer that falls behind, what is dropped is
+// counted and the rest still comes out in order and intact
+void test_overflow()
+{
+  const uint32_t n = 5000;
+  ubxqueue<1024> queue;
+  ublox gps;
+  bool done = false;
+  std::atomic<bool> finished( false );
+  uint32_t bad = 0;
+  uint32_t got = 0;
+
+  gps.attach( queue );
+
+  std::thread producer( [&]()
+  {
+    for( uint32_t k = 0; k < n; k++ )
+    {
+      std::vector<uint8_t> f = satframe( k );
+
+      gps.parse( f.data(), f.size() );
+    }
+
+    finished.store( true );
+  } );
+
+  std::thread consumer( [&]()
+  {
+    ubxframe frame;
+    int64_t last = -1;
+
+    while( !done )
+    {
+      done = finished.load();  // one more pass after the producer is done
+
+      while( queue.front( frame ) )
+      {
+        int64_t k = sequence( frame );
+
+        if( k <= last || !same( frame, k ) )
+          bad++;
+
+        last = k;
+        got++;
+        queue.pop();
+
+        if( got % 64 == 0 )
+          std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+      }
+    }
+  } );
+
+  producer.join();
+  consumer.join();
+
+  TEST_ASSERT_EQUAL_UINT32( 0, bad );
+  TEST_ASSERT_EQUAL_UINT32( got, queue.getpushed() );
+  TEST_ASSERT_EQUAL_UINT32( n, got + queue.getoverflows() );
+  TEST_ASSERT_TRUE( queue.getoverflows() > 0 );
+}
+
+// A full queue drops exactly what doesn't fit and keeps the rest
+void test_full()
+{
+  ubxqueue<256> queue;
+  std::vector<uint8_t> f = satframe( 2 );  // 36 bytes queued, 40 with the record header
+  ubxframe frame = { Message::navsat, &f[2], (uint16_t)( f.size() - 4 ) };
+  uint8_t pushed = 0;
+
+  for( uint8_t i = 0; i < 10; i++ )
+    pushed += queue.push( frame );
+
+  TEST_ASSERT_EQUAL( 256 / 40, pushed );
+  TEST_ASSERT_EQUAL_UINT32( 10 - pushed, queue.getoverflows() );
+
+  for( uint8_t i = 0; i < pushed; i++ )
+  {
+    TEST_ASSERT_TRUE( queue.front( frame ) );
+    TEST_ASSERT_TRUE( same( frame, 2 ) );
+    queue.pop();
+  }
+
+  TEST_ASSERT_TRUE( queue.empty() );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_order );
+  RUN_TEST( test_overflow );
+  RUN_TEST( test_full );
+  return UNITY_END();
+}
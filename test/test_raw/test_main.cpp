@@ -0,0 +1,134 @@
+/*
+  RXM-RAWX epochs into a ubxraw store
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+// An epoch of n signals, prMes counts up from k * 1000
+static std::vector<uint8_t> rawx( uint32_t k, uint8_t n )
+{
+  std::vector<uint8_t> payload( 16 + 32 * n, 0 );
+  double tow = k;
+
+  memcpy( &payload[0], &tow, 8 );
+  payload[11] = n;
+  payload[13] = 1;
+  for( uint8_t i = 0; i < n; i++ )
+  {
+    double pr = k * 1000.0 + i;
+    memcpy( &payload[16 + 32 * i], &pr, 8 );
+    payload[16 + 32 * i + 21] = i;  // svId
+  }
+
+  return ubxframeof( 0x02, 0x15, payload );
+}
+
+static void feed( ublox &gps, const std::vector<uint8_t> &f )
+{
+  gps.parse( f.data(), f.size() );
+}
+
+static bool check( ubxraw<16, 4> &raw, uint32_t k, uint8_t n )
+{
+  const ubxrawepoch &e = raw.front();
+
+  if( (uint32_t)e.rcvTow != k || e.count != n )
+    return false;
+
+  for( uint8_t i = 0; i < n; i++ )
+    if( raw.prMes[e.first + i] != k * 1000.0 + i || raw.svId[e.first + i] != i )
+      return false;
+
+  return true;
+}
+
+// nothing tracked yet, the empty epoch must not block the ones behind it
+void test_empty_epoch()
+{
+  ublox gps;
+  ubxraw<16, 4> raw;
+
+  raw.attach( gps );
+  feed( gps, rawx( 1, 0 ) );
+  feed( gps, rawx( 2, 5 ) );
+  feed( gps, rawx( 3, 5 ) );
+
+  TEST_ASSERT_EQUAL( 3, raw.available() );
+  TEST_ASSERT_EQUAL( 0, raw.getdropped() );
+  TEST_ASSERT_TRUE( check( raw, 1, 0 ) );
+  raw.pop();
+  TEST_ASSERT_TRUE( check( raw, 2, 5 ) );
+  raw.pop();
+  TEST_ASSERT_TRUE( check( raw, 3, 5 ) );
+  raw.pop();
+  TEST_ASSERT_EQUAL( 0, raw.available() );
+}
+
+// the arrays fill, then wrap as the consumer catches up
+void test_full_and_wrap()
+{
+  ublox gps;
+  ubxraw<16, 4> raw;
+
+  raw.attach( gps );
+  feed( gps, rawx( 1, 6 ) );
+  feed( gps, rawx( 2, 6 ) );
+  feed( gps, rawx( 3, 6 ) );  // no room
+  TEST_ASSERT_EQUAL( 2, raw.available() );
+  TEST_ASSERT_EQUAL( 1, raw.getdropped() );
+
+  raw.pop();
+  feed( gps, rawx( 4, 6 ) );  // at the start again
+  feed( gps, rawx( 5, 0 ) );
+  feed( gps, rawx( 6, 4 ) );  // epoch 2 is still in the way
+  TEST_ASSERT_EQUAL( 3, raw.available() );
+  TEST_ASSERT_EQUAL( 2, raw.getdropped() );
+
+  feed( gps, rawx( 7, 0 ) );
+  feed( gps, rawx( 8, 0 ) );  // no epoch left
+  TEST_ASSERT_EQUAL( 4, raw.available() );
+  TEST_ASSERT_EQUAL( 3, raw.getdropped() );
+
+  TEST_ASSERT_TRUE( check( raw, 2, 6 ) );
+  raw.pop();
+  TEST_ASSERT_TRUE( check( raw, 4, 6 ) );
+  raw.pop();
+  TEST_ASSERT_TRUE( check( raw, 5, 0 ) );
+  raw.pop();
+  feed( gps, rawx( 9, 10 ) );  // only the empty epoch 7 is left
+  TEST_ASSERT_TRUE( check( raw, 7, 0 ) );
+  raw.pop();
+  TEST_ASSERT_TRUE( check( raw, 9, 10 ) );
+  raw.pop();
+
+  // all popped, the whole arrays are free
+  feed( gps, rawx( 8, 16 ) );
+  TEST_ASSERT_TRUE( check( raw, 8, 16 ) );
+}
+
+void test_bad_checksum()
+{
+  ublox gps;
+  ubxraw<16, 4> raw;
+  std::vector<uint8_t> f = rawx( 1, 3 );
+
+  raw.attach( gps );
+  f.back() ^= 1;
+  feed( gps, f );
+  feed( gps, rawx( 2, 3 ) );
+
+  TEST_ASSERT_EQUAL( 1, raw.available() );
+  TEST_ASSERT_EQUAL( 1, raw.getdropped() );
+  TEST_ASSERT_TRUE( check( raw, 2, 3 ) );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_empty_epoch );
+  RUN_TEST( test_full_and_wrap );
+  RUN_TEST( test_bad_checksum );
+  return UNITY_END();
+}
@@ -0,0 +1,128 @@
+/*
+  Parsing straight out of a ring gives the same packets as parsing a
+  buffer, packets wrapping around the end of the ring included
+*/
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+// NAV-PVT, NAV-SAT of all sizes, ACK and NAV-EOE with noise in between
+static std::vector<uint8_t> traffic()
+{
+  std::vector<uint8_t> data;
+
+  srand( 11 );
+  for( int i = 0; i < 300; i++ )
+  {
+    int noise = rand() % 3 ? 0 : rand() % 20;
+
+    for( int k = 0; k < noise; k++ )
+      data.push_back( rand() % 8 ? rand() : 0xB5 );
+
+    std::vector<uint8_t> payload;
+    uint8_t cl = 0x01;
+    uint8_t id;
+
+    switch( rand() % 4 )
+    {
+      case 0:
+        id = 0x07;
+        payload.resize( 92 );
+        break;
+
+      case 1:
+      {
+        uint8_t svs = rand() % 85;
+
+        id = 0x35;
+        payload.resize( 8 + 12 * svs );
+        payload[5] = svs;
+      }
+      break;
+
+      case 2:
+        cl = 0x05;
+        id = 0x01;
+        payload.resize( 2 );
+        break;
+
+      default:
+        id = 0x61;
+        payload.resize( 4 );
+        break;
+    }
+
+    for( size_t k = 0; k < payload.size(); k++ )
+      if( k != 5 || id != 0x35 )
+        payload[k] = rand();
+
+    std::vector<uint8_t> f = ubxframeof( cl, id, payload );
+
+    data.insert( data.end(), f.begin(), f.end() );
+  }
+
+  return data;
+}
+
+void test_wrap()
+{
+  std::vector<uint8_t> data = traffic();
+  ublox flat;
+  ubxframes want;
+
+  flat.onframe( collect, &want );
+  flat.parse( data.data(), data.size() );
+  TEST_ASSERT_TRUE( want.size() > 250 );
+
+  const size_t sizes[] = { 1100, 1499, 2048, 4099 };
+  const size_t chunks[] = { 1, 13, 256, 1000 };
+
+  for( size_t size : sizes )
+    for( size_t chunk : chunks )
+    {
+      ublox ring;
+      ubxframes got;
+
+      ring.onframe( collect, &got );
+      ringfeed( ring, data, size, chunk );
+
+      TEST_ASSERT_TRUE( got == want );
+      TEST_ASSERT_EQUAL_UINT32( flat.getchecksumerrors(), ring.getchecksumerrors() );
+      TEST_ASSERT_EQUAL_UINT32( flat.getstats().bytes, ring.getstats().bytes );
+    }
+}
+
+// A length that doesn't fit the 16 bit count with the header is turned
+// away at once, not waited on
+void test_length()
+{
+  std::vector<uint8_t> data = { 0xB5, 0x62, 0x0A, 0x77, 0xFE, 0xFF };
+
+  for( uint8_t i = 0; i < 10; i++ )
+  {
+    std::vector<uint8_t> f = ubxframeof( 0x05, 0x01, std::vector<uint8_t>{ 0x06, i } );
+
+    data.insert( data.end(), f.begin(), f.end() );
+  }
+
+  ublox ring;
+  ubxframes got;
+
+  ring.setskipmode( SkipMode::skip );
+  ring.onframe( collect, &got );
+  ringfeed( ring, data, 70000, 64 );
+
+  TEST_ASSERT_EQUAL( 10, got.size() );
+  TEST_ASSERT_EQUAL_UINT32( 0, ring.getstats().skipped );
+  TEST_ASSERT_EQUAL_UINT32( 1, ring.getstats().headerrejects );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_wrap );
+  RUN_TEST( test_length );
+  return UNITY_END();
+}
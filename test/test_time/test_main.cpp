@@ -0,0 +1,134 @@
+/*
+  Integer NAV-PVT time against a plain day count, and what it costs next to
+  the double arithmetic the examples used to do
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "../ubxtest.h"
+
+static bool leap( int32_t y )
+{
+  return ( y % 4 == 0 && y % 100 != 0 ) || y % 400 == 0;
+}
+
+static uint8_t monthdays( int32_t y, uint8_t m )
+{
+  static const uint8_t days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+  return m == 2 && leap( y ) ? 29 : days[m - 1];
+}
+
+// Every day from 1600 to 2400 one after the other, which covers the 400
+// year cycle both sides of 1970 and all of NAV-PVT's 1999 to 2099
+void test_days()
+{
+  int32_t n = -135140;  // 1600-01-01
+
+  for( int32_t y = 1600; y <= 2400; y++ )
+    for( uint8_t m = 1; m <= 12; m++ )
+      for( uint8_t d = 1; d <= monthdays( y, m ); d++ )
+        TEST_ASSERT_EQUAL_INT32( n++, ubxdays( y, m, d ) );
+
+  TEST_ASSERT_EQUAL_INT32( 0, ubxdays( 1970, 1, 1 ) );
+  TEST_ASSERT_EQUAL_INT32( 3657, ubxdays( 1980, 1, 6 ) );
+}
+
+// Every second of a day on both sides of a year end, and nano either side
+// of the second as NAV-PVT allows
+void test_unixnano()
+{
+  for( uint16_t y = 1999; y <= 2099; y += 100 )
+  {
+    int64_t day = ubxdays( y, 12, 31 ) * 86400LL * ubxnsps;
+
+    for( int32_t s = 0; s < 86400; s++ )
+    {
+      int64_t t = day + s * ubxnsps;
+
+      TEST_ASSERT_EQUAL_INT64( t, ubxunixnano( y, 12, 31, s / 3600, s / 60 % 60, s % 60, 0 ) );
+      TEST_ASSERT_EQUAL_INT64( t + 999999999, ubxunixnano( y, 12, 31, s / 3600, s / 60 % 60, s % 60, 999999999 ) );
+      TEST_ASSERT_EQUAL_INT64( t - 1, ubxunixnano( y, 12, 31, s / 3600, s / 60 % 60, s % 60, -1 ) );
+    }
+
+    TEST_ASSERT_EQUAL_INT64( day + 86400 * ubxnsps, ubxunixnano( y + 1, 1, 1, 0, 0, 0, 0 ) );
+  }
+
+  // 2019-02-11 12:00:00 UTC
+  TEST_ASSERT_EQUAL_INT64( 1549886400LL * ubxnsps, ubxunixnano( 2019, 2, 11, 12, 0, 0, 0 ) );
+}
+
+static std::vector<uint8_t> pvt( uint8_t valid, int32_t nano )
+{
+  std::vector<uint8_t> p( 92, 0 );
+  uint16_t year = 2019;
+
+  memcpy( &p[4], &year, 2 );
+  p[6] = 2;
+  p[7] = 11;
+  p[8] = 12;
+  p[11] = valid;
+  memcpy( &p[16], &nano, 4 );
+
+  return ubxframeof( 0x01, 0x07, p );
+}
+
+void test_navpvt()
+{
+  ublox gps;
+  std::vector<uint8_t> f = pvt( 0x03, -250 );
+  int64_t ns = 0;
+
+  gps.parse( f.data(), f.size() );
+  navpvt8 nav( gps );
+
+  TEST_ASSERT_TRUE( nav.getunixnano( ns ) );
+  TEST_ASSERT_EQUAL_INT64( 1549886400LL * ubxnsps - 250, ns );
+  TEST_ASSERT_TRUE( nav.getgpsnano( ns ) );
+  TEST_ASSERT_EQUAL_INT64( 1233921618LL * ubxnsps - 250, ns );
+  TEST_ASSERT_TRUE( nav.getgpsnano( ns, 17 ) );
+  TEST_ASSERT_EQUAL_INT64( 1233921617LL * ubxnsps - 250, ns );
+
+  // not until both the date and the time are valid
+  uint8_t invalid[] = { 0x00, 0x01, 0x02, 0x04, 0x05, 0x06 };
+
+  for( uint8_t v : invalid )
+  {
+    f = pvt( v, 0 );
+    gps.parse( f.data(), f.size() );
+    TEST_ASSERT_FALSE( nav.getunixnano( ns ) );
+    TEST_ASSERT_FALSE( nav.getgpsnano( ns ) );
+  }
+}
+
+static volatile int64_t sinkns;
+static volatile double sinksec;
+
+void test_benchmark()
+{
+  const int32_t n = 1000000;
+  uint64_t t0 = nanos();
+
+  for( int32_t i = 0; i < n; i++ )
+    sinkns = ubxunixnano( 2019, 1 + i % 12, 1 + i % 28, i % 24, i % 60, i % 60, i );
+
+  uint64_t t1 = nanos();
+
+  for( int32_t i = 0; i < n; i++ )
+    sinksec = 3600.0 * ( i % 24 ) + 60.0 * ( i % 60 ) + 1.0 * ( i % 60 ) + i * 1e-9;
+
+  uint64_t t2 = nanos();
+
+  report( "ubxunixnano(), date and time", (double)( t1 - t0 ) / n );
+  report( "double, time of day only", (double)( t2 - t1 ) / n );
+}
+
+int main( int argc, char **argv )
+{
+  UNITY_BEGIN();
+  RUN_TEST( test_days );
+  RUN_TEST( test_unixnano );
+  RUN_TEST( test_navpvt );
+  RUN_TEST( test_benchmark );
+  return UNITY_END();
+}
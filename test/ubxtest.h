@@ -0,0 +1,102 @@
+/*
+  What the tests need from Arduino to build the library on the host, and a
+  sendPacket() that keeps everything sent to the receiver
+*/
+
+#ifndef ubxtest_h
+#define ubxtest_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+typedef uint8_t byte;
+
+struct _hostserial
+{
+  void print( const char *s ) { fputs( s, stdout ); }
+  void print( char c ) { putchar( c ); }
+  void println() { putchar( '\n' ); }
+};
+
+static _hostserial Serial;
+
+static std::vector<uint8_t> sent;
+
+void sendPacket( const byte *packet, uint16_t len )
+{
+  sent.insert( sent.end(), packet, packet + len );
+}
+
+#include "u-blox-m8.h"
+
+// A whole UBX frame, checksum included, around a payload
+static std::vector<uint8_t> ubxframeof( uint8_t cl, uint8_t id, const std::vector<uint8_t> &payload )
+{
+  std::vector<uint8_t> f( 2 + 4 + payload.size() + 2 );
+
+  f[0] = 0xB5;
+  f[1] = 0x62;
+  f[2] = cl;
+  f[3] = id;
+  f[4] = (uint8_t)payload.size();
+  f[5] = (uint8_t)( payload.size() >> 8 );
+  std::copy( payload.begin(), payload.end(), f.begin() + 6 );
+  ubxchecksum( &f[f.size() - 2], &f[2], f.size() - 4 );
+  return f;
+}
+
+// Every packet a parser hands over, as its bytes from the class on
+typedef std::vector<std::vector<uint8_t>> ubxframes;
+
+static void collect( const ubxframe &frame, void *context )
+{
+  ( (ubxframes *)context )->push_back( std::vector<uint8_t>( frame.data, frame.data + frame.length ) );
+}
+
+// Feeds data through a ring the way a serial driver would, a chunk at a
+// time and never over what the parser hasn't finished with. One byte is
+// kept free so a full ring can be told from an empty one.
+template<class P>
+static void ringfeed( P &gps, const std::vector<uint8_t> &data, size_t size, size_t chunk )
+{
+  std::vector<uint8_t> ring( size );
+  size_t head = 0;
+  size_t tail = 0;
+  size_t i = 0;
+
+  while( i < data.size() )
+  {
+    size_t space = ( tail + size - head - 1 ) % size;
+    size_t n = std::min( std::min( chunk, space ), data.size() - i );
+    size_t was = tail;
+
+    for( size_t k = 0; k < n; k++ )
+      ring[( head + k ) % size] = data[i + k];
+
+    head = ( head + n ) % size;
+    i += n;
+    gps.parse( ring.data(), size, tail, head );
+
+    if( n == 0 && tail == was )
+      break;  // a packet longer than the ring, the driver would be stuck too
+  }
+}
+
+// For the benchmarks, the timings are printed rather than checked
+static uint64_t nanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static void report( const char *what, double ns )
+{
+  char line[100];
+
+  snprintf( line, sizeof( line ), "%-40s %10.1f ns", what, ns );
+  TEST_MESSAGE( line );
+}
+
+#endif